@@ -35,12 +35,18 @@
  *		Cleaned up code for distribution.
  */
 
+#define _GNU_SOURCE  /* for sched_setaffinity */
+
 #include <errno.h>
-#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
 #include <time.h>
 
 #include "assert.h"
@@ -48,6 +54,8 @@
 #include "modex.h"
 #include "photo.h"
 #include "text.h"
+#include "timer_wheel.h"
+#include "verb_hash.h"
 #include "world.h"
 
 
@@ -63,9 +71,59 @@ static int sanity_check (void);
 
 
 /* a few constants */
-#define TICK_USEC      50000 /* tick length in microseconds          */
+#define TICK_USEC      50000 /* simulation step (input and timed events) */
+#define PRESENT_HZ     60    /* screen updates per second, at most   */
 #define STATUS_MSG_LEN 40    /* maximum length of status message     */
-#define MOTION_SPEED   2     /* pixels moved per command             */
+#define STATUS_MSG_TICKS (1500000 / TICK_USEC) /* ticks message shown  */
+#define TUX_TIME_TICKS  (1000000 / TICK_USEC)  /* ticks per Tux update */
+#define MOTION_SPEED   40    /* scrolling speed in pixels per second */
+#define MAX_INPUT_FDS  4     /* input devices watched by event loop  */
+#define MAX_LOOP_EVENTS 8    /* events handled per event loop wakeup */
+#define PRESENT_VSYNC  VSYNC_OFF /* VSYNC_OFF, VSYNC_HW, or VSYNC_SIM    */
+#define USE_ROOM_VIEW_CACHE 1    /* 0 redraws every room on entry      */
+#define ROOM_VIEW_SLOTS 16       /* rooms with cached entry views      */
+
+/*
+ * Low-jitter mode: when USE_LOW_JITTER is non-zero, the game pins itself
+ * to the CPUs in LOW_JITTER_CPUS (a bit mask), switches to SCHED_FIFO at
+ * LOW_JITTER_FIFO_PRIO (unless it is 0), locks all of its memory, and
+ * prefaults the room photos, object images, canvas, build buffer, view
+ * cache, and PREFAULT_STACK bytes of stack before play begins.  Steps 
+ * that fail (most need privileges) are reported and skipped.  Of these,
+ * SCHED_FIFO is the one that keeps tick wakeups on time while other work
+ * competes for the CPU; on an idle machine the mode changes little.
+ */
+#define USE_LOW_JITTER      0
+#define LOW_JITTER_CPUS     0x2
+#define LOW_JITTER_FIFO_PRIO 0
+#define PREFAULT_STACK      (64 * 1024)
+
+/* 
+ * Tick budget accounting: a tick overruns if ticks were missed or the 
+ * loop was busy for more than OVERRUN_PCT percent of it.  After 
+ * DEGRADE_TICKS overrunning ticks in a row, rendering quality drops one
+ * level; after RECOVER_TICKS ticks in a row that stay under HEADROOM_PCT
+ * percent busy, it rises one level.
+ */
+#define OVERRUN_PCT    80
+#define HEADROOM_PCT   40
+#define DEGRADE_TICKS  3
+#define RECOVER_TICKS  40
+#define DEGRADED_STATUS_DIV 4   /* status bar drawn every Nth update     */
+#define DEGRADED_PRESENT_DIV 2  /* screen updated every Nth present tick */
+
+/* 
+ * A status message slot, published with a sequence lock.  The writer 
+ * makes seq odd, changes the message, then makes seq even again; a 
+ * reader copies the message and retries if seq was odd or changed while 
+ * it copied.  Readers never block the writer, and a reader that has 
+ * already seen the current seq need not copy at all.
+ */
+typedef struct status_slot_t status_slot_t;
+struct status_slot_t {
+    uint32_t seq;                   /* odd while a write is in progress */
+    char msg[STATUS_MSG_LEN + 1];   /* message, or empty for none       */
+};
 
 /* outcome of the game */
 typedef enum {GAME_WON, GAME_QUIT} game_condition_t;
@@ -74,10 +132,72 @@ typedef enum {GAME_WON, GAME_QUIT} game_condition_t;
 typedef struct {
     room_t*      where;		 /* current room for player               */
     unsigned int map_x, map_y;   /* current upper left display pixel      */
-    int          x_speed;        /* number of pixels of x motion per move */
-    int          y_speed;        /* number of pixels of y motion per move */
+    int          x_speed;        /* pixels per second of x motion         */
+    int          y_speed;        /* pixels per second of y motion         */
+    int32_t      target_x;       /* upper left pixel after current motion */
+    int32_t      target_y;
+    int32_t      from_x;         /* upper left pixel when motion started  */
+    int32_t      from_y;
+    struct timespec glide_start; /* time at which motion started          */
 } game_info_t;
 
+/*
+ * A cached image of a room's (0,0) view window, in the planar form used
+ * by the mode X build buffer.  The image is valid while the room's 
+ * version (see room_version) matches the version recorded here.
+ */
+typedef struct room_view_t room_view_t;
+struct room_view_t {
+    const room_t* room;	   /* room shown, or NULL for an unused slot */
+    uint32_t version;	   /* room version when image was drawn      */
+    unsigned char* img;	   /* VIEW_SAVE_SIZE bytes of planar image   */
+};
+
+/* 
+ * Rendering quality levels, from full quality down.  Each level also 
+ * includes the savings of the levels above it.  Leaving objects out saves
+ * nothing when the room is drawn from its canvas (see USE_ROOM_CANVAS in
+ * photo.c), as canvas lines always include them, so that level is then 
+ * passed over (see account_tick).
+ */
+typedef enum {
+    DEGRADE_NONE,          /* full quality                               */
+    DEGRADE_NO_OBJECTS,    /* objects not drawn while the view glides    */
+    DEGRADE_STATUS_RATE,   /* status bar drawn at 1/DEGRADED_STATUS_DIV  */
+    DEGRADE_PRESENT_RATE,  /* screen updated at 1/DEGRADED_PRESENT_DIV   */
+    NUM_DEGRADE_LEVELS
+} degrade_level_t;
+
+/* tick budget accounting and the resulting degradation */
+typedef struct {
+    degrade_level_t level;      /* current rendering quality level     */
+    degrade_level_t max_level;  /* worst level reached                 */
+    unsigned long ticks;        /* ticks accounted                     */
+    unsigned long overruns;     /* ticks that overran their budget     */
+    unsigned long missed_ticks; /* ticks that passed with no wakeup    */
+    unsigned long level_changes;/* changes of level in either direction */
+    unsigned long busy_usec;    /* work done in the current tick       */
+    int run;                    /* consecutive overruns (if positive)  */
+                                /* or ticks with headroom (negative)   */
+} degrade_stats_t;
+
+/* lateness of tick timer wakeups (from due time to loop wakeup) */
+typedef struct {
+    unsigned long samples;      /* tick wakeups measured             */
+    unsigned long total_usec;   /* sum of lateness                   */
+    unsigned long max_usec;     /* worst lateness                    */
+    unsigned long over_100us;   /* wakeups more than 100 usec late   */
+    unsigned long over_1ms;     /* wakeups more than 1 msec late     */
+} jitter_stats_t;
+
+/* room entry timing (prep_room plus drawing the first view) */
+typedef struct {
+    unsigned long entries;	/* number of room entries             */
+    unsigned long cache_hits;	/* entries drawn from cached views    */
+    unsigned long total_usec;	/* sum of per-entry latency           */
+    unsigned long max_usec;	/* worst per-entry latency            */
+} room_entry_stats_t;
+
 
 /* 
  * enumerated values, structure, and static data used for parsing typed 
@@ -112,21 +232,9 @@ struct typed_cmd_t {
 };
 
 static const typed_cmd_t cmd_list[] = {
-    {"buy",       3, TC_BUY},
-    {"charge",    2, TC_CHARGE},
-    {"do",        2, TC_DO},
-    {"drink",     3, TC_DRINK},
-    {"drop",      2, TC_DROP},
-    {"fix",       3, TC_FIX},
-    {"flash",     5, TC_FLASH},
-    {"get",       1, TC_GET},
-    {"go",        2, TC_GO},
-    {"grab",      2, TC_GET},
-    {"install",   3, TC_INSTALL},
-    {"inventory", 1, TC_INVENTORY},
-    {"sigh",      4, TC_SIGH},
-    {"use",       3, TC_USE},
-    {"wear",      4, TC_WEAR},
+#define TYPED_CMD(verb, min_len, cmd) {verb, min_len, cmd},
+#include "cmd_list.def"
+#undef TYPED_CMD
     {NULL, 0, 0}
 };
 
@@ -136,55 +244,59 @@ static const typed_cmd_t cmd_list[] = {
 static game_condition_t game_loop (void);
 static int32_t handle_typing (void);
 static void init_game (void);
-static void move_photo_down (void);
-static void move_photo_left (void);
-static void move_photo_right (void);
-static void move_photo_up (void);
+static void move_photo_down (int32_t step);
+static void move_photo_left (int32_t step);
+static void move_photo_right (int32_t step);
+static void move_photo_up (int32_t step);
 static void redraw_room (void);
-static void* status_thread (void* ignore);
-static int time_is_after (struct timeval* t1, struct timeval* t2);
+static void scroll_view (int32_t dx, int32_t dy);
+static void scroll_view_pixels (int32_t dx, int32_t dy);
+static int32_t glide_view (void);
+static void account_tick (uint64_t expired);
+static long usec_since (const struct timespec* t);
+static void account_jitter (const struct timespec* epoch, uint32_t ticks);
+static void enter_low_jitter_mode (void);
+static void draw_room_entry (void);
+static void publish_status (const char* s);
+static uint32_t read_status (char buf[STATUS_MSG_LEN + 1], uint32_t seen);
+static void expire_status (void* ignore);
+static void update_tux_time (void* ignore);
 
 
 /* file-scope variables */
 
 static game_info_t game_info; /* game information */
 
+static room_view_t room_view[ROOM_VIEW_SLOTS]; /* cached entry views    */
+static int next_view_slot;                     /* next slot to replace  */
+static room_entry_stats_t entry_stats;         /* room entry latency    */
+static unsigned long presents;                 /* screens presented     */
+static unsigned long dropped_presents;         /* presents skipped      */
+static degrade_stats_t degrade;                /* tick budget and level */
+static jitter_stats_t jitter;                  /* tick wakeup lateness  */
+
 
 /* 
- * The variables below are used to keep track of the status message helper
- * thread, with Posix thread id recorded in status_thread_id.  
- *
- * The status_msg records the current status message: when the
- * string recorded there is empty, no status message need be displayed, and
- * the status bar should instead reflect the name of the current room and the
- * player's typing (for typed commands).
- *
- * The status_msg is protected by the msg_lock mutex, which should be
- * acquired before reading or writing the message.  Further, if the message
- * is changed, the helper thread must be notified by signaling it with the 
- * condition variable msg_cv (while holding the msg_lock).
+ * The status_slot records the current status message: when the string 
+ * recorded there is empty, no status message need be displayed, and
+ * the status bar should instead reflect the name of the current room and 
+ * the player's typing (for typed commands).  Messages are published by
+ * show_status and cleared by status_timer once they have been shown for 
+ * STATUS_MSG_TICKS.  Only the game loop's thread writes the slot.
  */
-
-static pthread_t status_thread_id;
-static pthread_mutex_t msg_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t  msg_cv = PTHREAD_COND_INITIALIZER;
-static char status_msg[STATUS_MSG_LEN + 1] = {'\0'};
-
+static status_slot_t status_slot;
+static game_timer_t status_timer;
 
 /* 
- * cancel_status_thread
- *   DESCRIPTION: Terminates the status message helper thread.  Used as
- *                a cleanup method to ensure proper shutdown.
- *   INPUTS: none (ignored)
- *   OUTPUTS: none
- *   RETURN VALUE: none
- *   SIDE EFFECTS: none
+ * Timed (asynchronous) events are kept in game_timers, which is advanced
+ * by the game loop once for each tick of the tick timer.  The Tux 
+ * controller's clock is one such event, redrawn once per second to show
+ * the time elapsed since game_start_time.
  */
-static void
-cancel_status_thread (void* ignore)
-{
-    (void)pthread_cancel (status_thread_id);
-}
+static timer_wheel_t game_timers;
+static game_timer_t tux_time_timer;
+static struct timespec game_start_time;
+
 
 /* 
  * game_loop
@@ -201,128 +313,267 @@ game_loop ()
      * Variables used to carry information between event loop ticks; see
      * initialization below for explanations of purpose.
      */
-    struct timeval start_time, tick_time;
-
-    struct timeval cur_time; /* current time (during tick)      */
-    cmd_t cmd;               /* command issued by input control */
-    int32_t enter_room;      /* player has changed rooms        */
+    uint32_t ticks;             /* ticks elapsed since start         */
+
+    struct itimerspec period;   /* tick timer period                 */
+    struct timespec tick_epoch; /* time at which tick 0 was due      */
+    struct epoll_event ev;      /* event to register                 */
+    struct epoll_event events[MAX_LOOP_EVENTS]; /* events delivered  */
+    int in_fds[MAX_INPUT_FDS];  /* input file descriptors            */
+    int n_in;                   /* number of input file descriptors  */
+    int ep_fd;                  /* the epoll set                     */
+    int tick_fd;                /* timerfd for ticks                 */
+    int present_fd;             /* timerfd for screen updates        */
+    uint64_t expired;           /* expirations since last read       */
+    int n_ev;                   /* number of events delivered        */
+    int wake;                   /* tick or input has arrived         */
+    int tick_due;               /* a tick has passed since last poll */
+    int present_due;            /* time to update the screen         */
+    unsigned long present_ticks; /* present timer ticks seen         */
+    struct timespec woke;       /* time at which loop last woke      */
+    int32_t dirty;              /* screen must be shown again        */
+    int fast;                   /* view gliding while degraded       */
+    input_event_t in_ev;        /* command issued by input control   */
+    int input_left;             /* input may remain in the queue     */
+    int32_t enter_room;         /* player has changed rooms          */
+    char status_msg[STATUS_MSG_LEN + 1]; /* last status message read */
+    uint32_t status_seq;        /* sequence number of status_msg     */
+    int i;                      /* loop index over fds and events    */
 
-    /* Record the starting time--assume success. */
-    (void)gettimeofday (&start_time, NULL);
-
-    /* Calculate the time at which the first event loop tick should occur. */
-    tick_time = start_time;
-    if ((tick_time.tv_usec += TICK_USEC) > 1000000) {
-	tick_time.tv_sec++;
-	tick_time.tv_usec -= 1000000;
+    /* 
+     * Build the event set: a periodic timer for simulation ticks, another
+     * for screen updates, plus the input devices.  A timerfd reports
+     * several expirations at once if we were too busy to read it; we
+     * catch up on every missed tick, but skip missed screen updates.
+     * Tick n is due at an absolute time, tick_epoch plus n ticks, against
+     * which the lateness of each wakeup is measured.
+     */
+    if (-1 == (ep_fd = epoll_create (MAX_INPUT_FDS + 2)) ||
+	-1 == (tick_fd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK)) ||
+	-1 == (present_fd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK))) {
+	PANIC ("cannot create event loop descriptors");
+    }
+    (void)clock_gettime (CLOCK_MONOTONIC, &tick_epoch);
+    period.it_interval.tv_sec = 0;
+    period.it_interval.tv_nsec = TICK_USEC * 1000;
+    period.it_value = tick_epoch;
+    period.it_value.tv_nsec += TICK_USEC * 1000;
+    if (1000000000 <= period.it_value.tv_nsec) {
+	period.it_value.tv_sec++;
+	period.it_value.tv_nsec -= 1000000000;
+    }
+    ev.events = EPOLLIN;
+    ev.data.fd = tick_fd;
+    if (0 != timerfd_settime (tick_fd, TFD_TIMER_ABSTIME, &period, NULL) ||
+	0 != epoll_ctl (ep_fd, EPOLL_CTL_ADD, tick_fd, &ev)) {
+	PANIC ("cannot start tick timer");
+    }
+    period.it_interval.tv_nsec = 1000000000 / PRESENT_HZ;
+    period.it_value = period.it_interval;
+    ev.data.fd = present_fd;
+    if (0 != timerfd_settime (present_fd, 0, &period, NULL) ||
+	0 != epoll_ctl (ep_fd, EPOLL_CTL_ADD, present_fd, &ev)) {
+	PANIC ("cannot start present timer");
+    }
+    n_in = get_input_fds (in_fds, MAX_INPUT_FDS);
+    for (i = 0; n_in > i; i++) {
+	ev.data.fd = in_fds[i];
+	if (0 != epoll_ctl (ep_fd, EPOLL_CTL_ADD, in_fds[i], &ev)) {
+	    PANIC ("cannot watch input device");
+	}
     }
 
+    /* 
+     * Record the starting time--assume success--and start the timed
+     * events.  Timer wheel tick t is processed once t + 1 ticks have
+     * elapsed.
+     */
+    (void)clock_gettime (CLOCK_MONOTONIC, &game_start_time);
+    ticks = 0;
+    timer_wheel_init (&game_timers, ticks);
+    timer_init (&status_timer, expire_status, NULL);
+    timer_init (&tux_time_timer, update_tux_time, NULL);
+    timer_add (&game_timers, &tux_time_timer, 0);
+
     /* The player has just entered the first room. */
     enter_room = 1;
+    input_left = 0;
+    present_due = 1;
+    present_ticks = 0;
+    dirty = 1;
+    (void)clock_gettime (CLOCK_MONOTONIC, &woke);
+    status_msg[0] = '\0';
+    status_seq = read_status (status_msg, 1);
 
     /* The main event loop. */
     while (1) {
 
 	/* 
-	 * Update the screen, preparing the VGA palette and photo-drawing
-	 * routines and drawing a new room photo first if the player has
-	 * entered a new room, then showing the screen (and status bar,
-	 * once you have it working).
+	 * Prepare the VGA palette and photo-drawing routines and draw a
+	 * new room photo if the player has entered a new room.
 	 */
 	if (enter_room) {
 	    /* Reset the view window to (0,0). */
 	    game_info.map_x = game_info.map_y = 0;
+	    game_info.target_x = game_info.target_y = 0;
 	    set_view_window (game_info.map_x, game_info.map_y);
 
 	    /* Discard any partially-typed command. */
 	    reset_typed_command ();
 	    
-	    /* Adjust colors and photo drawing for the current room photo. */
-	    prep_room (game_info.where);
-
-	    /* Draw the room (calls show. */
-	    redraw_room ();
+	    /* Adjust colors and draw the room (from cache if possible). */
+	    draw_room_entry ();
 
 	    /* Only draw once on entry. */
 	    enter_room = 0;
+	    dirty = 1;
 	}
-	show_screen ();
-	/* use mutexes to synchronize the status bar */
-	pthread_mutex_lock(&msg_lock);
-	draw_status_bar(room_name(game_info.where), status_msg, get_typed_command());
-	pthread_mutex_unlock(&msg_lock);
+
 	/*
-	 * Wait for tick.  The tick defines the basic timing of our
-	 * event loop, and is the minimum amount of time between events.
+	 * Update the screen at most PRESENT_HZ times per second: bring the
+	 * status bar up to date (it is shared by both pages and redraws
+	 * only what has changed), move the view toward its target, and 
+	 * show the screen if anything has been drawn.  When the loop is
+	 * overloaded, fewer updates are made and the status bar is drawn
+	 * less often; objects are left out while the view glides, and 
+	 * drawn again once it stops.
 	 */
-	do {
-	    if (gettimeofday (&cur_time, NULL) != 0) {
-		/* Panic!  (should never happen) */
-		clear_mode_X ();
-		shutdown_input ();
-		perror ("gettimeofday");
-		exit (3);
+	if (present_due && DEGRADE_PRESENT_RATE <= degrade.level &&
+	    0 != present_ticks % DEGRADED_PRESENT_DIV) {
+	    present_due = 0;
+	}
+	if (present_due) {
+	    if (DEGRADE_STATUS_RATE > degrade.level ||
+	        0 == present_ticks % DEGRADED_STATUS_DIV) {
+		/* copy the status message only if it has changed */
+		status_seq = read_status (status_msg, status_seq);
+		draw_status_bar(room_name(game_info.where), status_msg, 
+				get_typed_command());
+	    }
+	    fast = (DEGRADE_NO_OBJECTS <= degrade.level &&
+		    (game_info.target_x != (int32_t)game_info.map_x ||
+		     game_info.target_y != (int32_t)game_info.map_y));
+	    dirty |= glide_view ();
+	    if (set_object_overlay (!fast)) {
+		redraw_room ();
+		dirty = 1;
+	    }
+	    if (dirty) {
+		show_screen ();
+		presents++;
+		dirty = 0;
 	    }
-	} while (!time_is_after (&cur_time, &tick_time));
+	    present_due = 0;
+	}
 
 	/*
-	 * Advance the tick time.  If we missed one or more ticks completely, 
-	 * i.e., if the current time is already after the time for the next 
-	 * tick, just skip the extra ticks and advance the clock to the one
-	 * that we haven't missed.
+	 * Sleep until the next tick, screen update, or input.  The tick 
+	 * defines the simulation step of our event loop; input is handled 
+	 * as soon as it arrives, and the result shown at the next screen
+	 * update.  All input available is then read into the input queue 
+	 * (and the Tux controller's buttons sampled).
 	 */
-	do {
-	    if ((tick_time.tv_usec += TICK_USEC) > 1000000) {
-		tick_time.tv_sec++;
-		tick_time.tv_usec -= 1000000;
-	    }
-	} while (time_is_after (&cur_time, &tick_time));
+	if (!input_left) {
+	    degrade.busy_usec += usec_since (&woke);
+	    do {
+		n_ev = epoll_wait (ep_fd, events, MAX_LOOP_EVENTS, -1);
+		if (-1 == n_ev && EINTR != errno) {
+		    /* Panic!  (should never happen) */
+		    clear_mode_X ();
+		    shutdown_input ();
+		    perror ("epoll_wait");
+		    exit (3);
+		}
+		wake = 0;
+		tick_due = 0;
+		for (i = 0; n_ev > i; i++) {
+		    if (tick_fd == events[i].data.fd) {
+			if (sizeof (expired) == 
+			    read (tick_fd, &expired, sizeof (expired))) {
+			    ticks += expired;
+			    account_jitter (&tick_epoch, ticks);
+			    account_tick (expired);
+			    tick_due = 1;
+			    wake = 1;
+			}
+		    } else if (present_fd == events[i].data.fd) {
+			if (sizeof (expired) == 
+			    read (present_fd, &expired, sizeof (expired))) {
+			    dropped_presents += expired - 1;
+			    present_ticks += expired;
+			    present_due = 1;
+			    wake = 1;
+			}
+		    } else {
+			wake = 1;
+		    }
+		}
+	    } while (!wake);
+	    (void)clock_gettime (CLOCK_MONOTONIC, &woke);
+	    poll_input (tick_due);
+	}
 
 	/*
-	 * Handle asynchronous events.  These events use real time rather
-	 * than tick counts for timing, although the real time is rounded
-	 * off to the nearest tick by definition.
+	 * Handle asynchronous events.  These events use tick counts for 
+	 * timing; all ticks that have passed since the last wakeup are 
+	 * processed, so events are never lost, only delayed.
 	 */
-	/* (none right now...) */
+	(void)timer_wheel_advance (&game_timers, ticks - 1);
 
 	/* 
 	 * Handle synchronous events--in this case, only player commands. 
-	 * Note that typed commands that move objects may cause the room
-	 * to be redrawn.
+	 * Every queued command is handled, with bursts of scrolling merged
+	 * into single moves of the view's target (the view itself glides
+	 * there during screen updates), until the player changes rooms; any
+	 * commands left after a room change are handled (in the new room)
+	 * without waiting for another event.  Note that typed commands that move 
+	 * objects may cause the room to be redrawn.
 	 */
-	
-	cmd = get_command ();
-	switch (cmd) {
-	    case CMD_UP:    move_photo_down ();  break;
-	    case CMD_RIGHT: move_photo_left ();  break;
-	    case CMD_DOWN:  move_photo_up ();    break;
-	    case CMD_LEFT:  move_photo_right (); break;
-	    case CMD_MOVE_LEFT:   
-		enter_room = (TC_CHANGE_ROOM == 
-			      try_to_move_left (&game_info.where));
-		break;
-	    case CMD_ENTER:
-		enter_room = (TC_CHANGE_ROOM ==
-			      try_to_enter (&game_info.where));
-		break;
-	    case CMD_MOVE_RIGHT:
-		enter_room = (TC_CHANGE_ROOM == 
-			      try_to_move_right (&game_info.where));
-		break;
-	    case CMD_TYPED:
-		if (handle_typing ()) {
-		    enter_room = 1;
-		}
+	input_left = 0;
+	while (get_input_event (&in_ev)) {
+	    switch (in_ev.cmd) {
+		case CMD_UP:    scroll_view (0, -in_ev.count); break;
+		case CMD_RIGHT: scroll_view (in_ev.count, 0);  break;
+		case CMD_DOWN:  scroll_view (0, in_ev.count);  break;
+		case CMD_LEFT:  scroll_view (-in_ev.count, 0); break;
+		case CMD_SCROLL: scroll_view_pixels (in_ev.dx, in_ev.dy); break;
+		case CMD_MOVE_LEFT:   
+		    enter_room = (TC_CHANGE_ROOM == 
+				  try_to_move_left (&game_info.where));
+		    break;
+		case CMD_ENTER:
+		    enter_room = (TC_CHANGE_ROOM ==
+				  try_to_enter (&game_info.where));
+		    break;
+		case CMD_MOVE_RIGHT:
+		    enter_room = (TC_CHANGE_ROOM == 
+				  try_to_move_right (&game_info.where));
+		    break;
+		case CMD_TYPED:
+		    if (handle_typing ()) {
+			enter_room = 1;
+		    }
+		    /* The room may have been redrawn. */
+		    dirty = 1;
+		    break;
+		case CMD_QUIT: 
+		    (void)close (present_fd);
+		    (void)close (tick_fd);
+		    (void)close (ep_fd);
+		    return GAME_QUIT;
+		default: break;
+	    }
+	    if (enter_room || NULL == game_info.where) {
+		input_left = 1;
 		break;
-	    case CMD_QUIT: return GAME_QUIT;
-	    default: break;
+	    }
 	}
 
-	/* get the current game time and put it on the tux */
-	display_time_on_tux(cur_time.tv_sec - start_time.tv_sec);
-
 	/* If player wins the game, their room becomes NULL. */
 	if (NULL == game_info.where) {
+	    (void)close (present_fd);
+	    (void)close (tick_fd);
+	    (void)close (ep_fd);
 	    return GAME_WON;
 	}
     } /* end of the main event loop */
@@ -343,7 +594,8 @@ handle_typing ()
     const char*      cmd;     /* command verb typed                */
     int32_t          cmd_len; /* length of command verb            */
     const char*      arg;     /* argument given to command verb    */
-    int32_t          idx;     /* loop index over command list      */
+    int32_t          idx;     /* index of verb in command list     */
+    const verb_slot_t* slot;  /* verb hash table slot for verb     */
     tc_action_t      result;  /* result of typed command execution */
 
     /* Read the command and strip leading spaces.  If it's empty, return. */
@@ -362,14 +614,16 @@ handle_typing ()
     arg = &cmd[cmd_len];
     while (' ' == *arg) { arg++; }
 
-    /* Compare the typed verb with each command in our list. */
-    for (idx = 0; NULL != cmd_list[idx].name; idx++) {
-
-        /* If the typed verb is not long enough, it can't match. */
-	if (cmd_list[idx].min_len > cmd_len) { continue; }
-
-	/* Compare the prefix of the command with the typed verb. */
-        if (0 != strncasecmp (cmd_list[idx].name, cmd, cmd_len)) { continue; }
+    /* 
+     * Look up the typed verb in the verb hash table, which holds every
+     * accepted abbreviation of every verb in our list (see lexicon.h).
+     * The verb matches only the word stored in its slot, if any.
+     */
+    slot = &verb_hash[lex_hash (cmd, cmd_len, VERB_HASH_SEED) &
+		      (VERB_HASH_SIZE - 1)];
+    if (VERB_MAX_LEN >= cmd_len && NULL != slot->word &&
+        slot->len == cmd_len && 0 == strncasecmp (slot->word, cmd, cmd_len)) {
+	idx = slot->idx;
 
 	/* Execute the command found. */
 	switch (cmd_list[idx].cmd) {
@@ -469,34 +723,150 @@ init_game ()
     game_info.map_y = 0;
     game_info.x_speed = MOTION_SPEED;
     game_info.y_speed = MOTION_SPEED;
+    game_info.target_x = game_info.from_x = 0;
+    game_info.target_y = game_info.from_y = 0;
+    (void)clock_gettime (CLOCK_MONOTONIC, &game_info.glide_start);
 }
 
 
 /* 
- * move_photo_down
- *   DESCRIPTION: Move background photo down one or more pixels.  Amount of
- *                motion depends on game_info.y_speed.  Movement stops at
- *                upper edge of photo.
+ * scroll_view
+ *   DESCRIPTION: Move the target of the view window in response to
+ *                scrolling commands.  Each command moves the target as
+ *                far as the view travels in one simulation step (TICK_USEC)
+ *                at the current speed.
+ *   INPUTS: dx -- number of rightward (negative for leftward) commands
+ *           dy -- number of downward (negative for upward) commands
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the target position and restarts the glide
+ */
+static void
+scroll_view (int32_t dx, int32_t dy)
+{
+    scroll_view_pixels (dx * game_info.x_speed * TICK_USEC / 1000000,
+			dy * game_info.y_speed * TICK_USEC / 1000000);
+}
+
+
+/* 
+ * scroll_view_pixels
+ *   DESCRIPTION: Move the target of the view window by a number of 
+ *                pixels (as for the Tux controller in mouse mode, where
+ *                faster movement scrolls farther).  The target stays 
+ *                within the room photo.  The view starts gliding from 
+ *                its present position toward the new target, so even a
+ *                long move is drawn a few lines at a time.
+ *   INPUTS: dx -- pixels to the right (negative for left)
+ *           dy -- pixels down (negative for up)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the target position and restarts the glide
+ */
+static void
+scroll_view_pixels (int32_t dx, int32_t dy)
+{
+    int32_t max_x = room_photo_width (game_info.where) - SCROLL_X_DIM;
+    int32_t max_y = room_photo_height (game_info.where) - SCROLL_Y_DIM;
+
+    game_info.target_x += dx;
+    game_info.target_y += dy;
+    if (max_x < game_info.target_x) {
+	game_info.target_x = max_x;
+    }
+    if (0 > game_info.target_x) {
+	game_info.target_x = 0;
+    }
+    if (max_y < game_info.target_y) {
+	game_info.target_y = max_y;
+    }
+    if (0 > game_info.target_y) {
+	game_info.target_y = 0;
+    }
+    game_info.from_x = game_info.map_x;
+    game_info.from_y = game_info.map_y;
+    (void)clock_gettime (CLOCK_MONOTONIC, &game_info.glide_start);
+}
+
+
+/* 
+ * glide_view
+ *   DESCRIPTION: Move the view window toward its target.  The view moves
+ *                in a straight line from where it was when the target
+ *                last changed and arrives one simulation step later, so
+ *                the motion is spread over all of the screen updates in
+ *                that step (or done at once if updates are slow).
  *   INPUTS: none
  *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the view moved, 0 if not
+ *   SIDE EFFECTS: shifts view window and draws newly exposed lines
+ */
+static int32_t
+glide_view ()
+{
+    struct timespec now; /* current time                      */
+    long usec;           /* time since glide started          */
+    int32_t x, y;        /* upper left pixel for this update  */
+
+    if (game_info.target_x == (int32_t)game_info.map_x &&
+        game_info.target_y == (int32_t)game_info.map_y) {
+	return 0;
+    }
+    (void)clock_gettime (CLOCK_MONOTONIC, &now);
+    usec = (now.tv_sec - game_info.glide_start.tv_sec) * 1000000 +
+	   (now.tv_nsec - game_info.glide_start.tv_nsec) / 1000;
+    if (TICK_USEC <= usec) {
+	x = game_info.target_x;
+	y = game_info.target_y;
+    } else {
+	x = game_info.from_x + 
+	    (game_info.target_x - game_info.from_x) * usec / TICK_USEC;
+	y = game_info.from_y + 
+	    (game_info.target_y - game_info.from_y) * usec / TICK_USEC;
+    }
+    if (x == (int32_t)game_info.map_x && y == (int32_t)game_info.map_y) {
+	return 0;
+    }
+    if (x > (int32_t)game_info.map_x) {
+	move_photo_left (x - game_info.map_x);
+    } else if (x < (int32_t)game_info.map_x) {
+	move_photo_right (game_info.map_x - x);
+    }
+    if (y > (int32_t)game_info.map_y) {
+	move_photo_up (y - game_info.map_y);
+    } else if (y < (int32_t)game_info.map_y) {
+	move_photo_down (game_info.map_y - y);
+    }
+    return 1;
+}
+
+
+/* 
+ * move_photo_down
+ *   DESCRIPTION: Move background photo down one or more pixels.  Movement
+ *                stops at upper edge of photo.
+ *   INPUTS: step -- number of pixels by which to move
+ *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: shifts view window
  */
 static void
-move_photo_down ()
+move_photo_down (int32_t step)
 {
     int32_t delta; /* Number of pixels by which to move. */
     int32_t idx;   /* Index over rows to redraw.         */
 
     /* Calculate the number of pixels by which to move. */
-    delta = (game_info.y_speed > game_info.map_y ?
-	     game_info.map_y : game_info.y_speed);
+    delta = (step > game_info.map_y ? game_info.map_y : step);
 
     /* Shift the logical view upward. */
     game_info.map_y -= delta;
     set_view_window (game_info.map_x, game_info.map_y);
 
-    /* Draw the newly exposed lines. */
+    /* Draw the newly exposed lines (at most a full screen of them). */
+    if (SCROLL_Y_DIM < delta) {
+	delta = SCROLL_Y_DIM;
+    }
     for (idx = 0; delta > idx; idx++) {
 	(void)draw_horiz_line (idx);
     }
@@ -505,16 +875,15 @@ move_photo_down ()
 
 /* 
  * move_photo_left
- *   DESCRIPTION: Move background photo left one or more pixels.  Amount of
- *                motion depends on game_info.x_speed.  Movement stops at
- *                right edge of photo.
- *   INPUTS: none
+ *   DESCRIPTION: Move background photo left one or more pixels.  Movement
+ *                stops at right edge of photo.
+ *   INPUTS: step -- number of pixels by which to move
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: shifts view window
  */
 static void
-move_photo_left ()
+move_photo_left (int32_t step)
 {
     int32_t delta; /* Number of pixels by which to move. */
     int32_t idx;   /* Index over columns to redraw.      */
@@ -522,13 +891,16 @@ move_photo_left ()
     /* Calculate the number of pixels by which to move. */
     delta = room_photo_width (game_info.where) - SCROLL_X_DIM -
     	    game_info.map_x;
-    delta = (game_info.x_speed > delta ? delta : game_info.x_speed);
+    delta = (step > delta ? delta : step);
 
     /* Shift the logical view to the right. */
     game_info.map_x += delta;
     set_view_window (game_info.map_x, game_info.map_y);
 
-    /* Draw the newly exposed lines. */
+    /* Draw the newly exposed lines (at most a full screen of them). */
+    if (SCROLL_X_DIM < delta) {
+	delta = SCROLL_X_DIM;
+    }
     for (idx = 1; delta >= idx; idx++) {
 	(void)draw_vert_line (SCROLL_X_DIM - idx);
     }
@@ -537,29 +909,30 @@ move_photo_left ()
 
 /* 
  * move_photo_right
- *   DESCRIPTION: Move background photo right one or more pixels.  Amount of
- *                motion depends on game_info.x_speed.  Movement stops at
- *                left edge of photo.
- *   INPUTS: none
+ *   DESCRIPTION: Move background photo right one or more pixels.  Movement
+ *                stops at left edge of photo.
+ *   INPUTS: step -- number of pixels by which to move
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: shifts view window
  */
 static void
-move_photo_right ()
+move_photo_right (int32_t step)
 {
     int32_t delta; /* Number of pixels by which to move. */
     int32_t idx;   /* Index over columns to redraw.      */
 
     /* Calculate the number of pixels by which to move. */
-    delta = (game_info.x_speed > game_info.map_x ?
-	     game_info.map_x : game_info.x_speed);
+    delta = (step > game_info.map_x ? game_info.map_x : step);
 
     /* Shift the logical view to the left. */
     game_info.map_x -= delta;
     set_view_window (game_info.map_x, game_info.map_y);
 
-    /* Draw the newly exposed lines. */
+    /* Draw the newly exposed lines (at most a full screen of them). */
+    if (SCROLL_X_DIM < delta) {
+	delta = SCROLL_X_DIM;
+    }
     for (idx = 0; delta > idx; idx++) {
 	(void)draw_vert_line (idx);
     }
@@ -568,16 +941,15 @@ move_photo_right ()
 
 /* 
  * move_photo_up
- *   DESCRIPTION: Move background photo up one or more pixels.  Amount of
- *                motion depends on game_info.y_speed.  Movement stops at
- *                lower edge of photo.
- *   INPUTS: none
+ *   DESCRIPTION: Move background photo up one or more pixels.  Movement
+ *                stops at lower edge of photo.
+ *   INPUTS: step -- number of pixels by which to move
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: shifts view window
  */
 static void
-move_photo_up ()
+move_photo_up (int32_t step)
 {
     int32_t delta; /* Number of pixels by which to move. */
     int32_t idx;   /* Index over rows to redraw.         */
@@ -585,19 +957,190 @@ move_photo_up ()
     /* Calculate the number of pixels by which to move. */
     delta = room_photo_height (game_info.where) - SCROLL_Y_DIM - 
     	    game_info.map_y;
-    delta = (game_info.y_speed > delta ? delta : game_info.y_speed);
+    delta = (step > delta ? delta : step);
 
     /* Shift the logical view upward. */
     game_info.map_y += delta;
     set_view_window (game_info.map_x, game_info.map_y);
 
-    /* Draw the newly exposed lines. */
+    /* Draw the newly exposed lines (at most a full screen of them). */
+    if (SCROLL_Y_DIM < delta) {
+	delta = SCROLL_Y_DIM;
+    }
     for (idx = 1; delta >= idx; idx++) {
 	(void)draw_horiz_line (SCROLL_Y_DIM - idx);
     }
 }
 
 
+/* 
+ * usec_since
+ *   DESCRIPTION: Measure the time elapsed since t.
+ *   INPUTS: t -- an earlier CLOCK_MONOTONIC time
+ *   OUTPUTS: none
+ *   RETURN VALUE: microseconds since t
+ *   SIDE EFFECTS: none
+ */
+static long
+usec_since (const struct timespec* t)
+{
+    struct timespec now; /* current time */
+
+    (void)clock_gettime (CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - t->tv_sec) * 1000000 + 
+	   (now.tv_nsec - t->tv_nsec) / 1000;
+}
+
+
+/* 
+ * account_jitter
+ *   DESCRIPTION: Record how late the loop woke up for the latest tick.
+ *   INPUTS: epoch -- time at which tick 0 was due
+ *           ticks -- number of the latest tick
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: updates jitter
+ */
+static void
+account_jitter (const struct timespec* epoch, uint32_t ticks)
+{
+    struct timespec now; /* current time                     */
+    long long late;      /* lateness of wakeup, microseconds */
+
+    (void)clock_gettime (CLOCK_MONOTONIC, &now);
+    late = (now.tv_sec - epoch->tv_sec) * 1000000LL + 
+	   (now.tv_nsec - epoch->tv_nsec) / 1000 - 
+	   (long long)ticks * TICK_USEC;
+    if (0 > late) {
+	late = 0;
+    }
+    jitter.samples++;
+    jitter.total_usec += late;
+    if (jitter.max_usec < (unsigned long)late) {
+	jitter.max_usec = late;
+    }
+    if (100 < late) {
+	jitter.over_100us++;
+	if (1000 < late) {
+	    jitter.over_1ms++;
+	}
+    }
+}
+
+
+/* 
+ * enter_low_jitter_mode
+ *   DESCRIPTION: Prepare the process to run the game loop with as little
+ *                scheduling and paging delay as possible: pin it to
+ *                LOW_JITTER_CPUS, optionally raise it to SCHED_FIFO, lock
+ *                its memory, and fault in everything the loop will touch.
+ *                Each step that fails is reported, and the rest go ahead.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes scheduling and memory locking of the process;
+ *                 allocates the view cache
+ */
+static void
+enter_low_jitter_mode ()
+{
+    unsigned char stack[PREFAULT_STACK]; /* stack area to prefault   */
+    cpu_set_t cpus;                      /* CPUs allowed             */
+    struct sched_param param;            /* real-time priority       */
+    int i;                               /* loop index over CPUs and */
+                                         /*    view cache slots      */
+
+    CPU_ZERO (&cpus);
+    for (i = 0; 32 > i && CPU_SETSIZE > i; i++) {
+	if (0 != (LOW_JITTER_CPUS & (1UL << i))) {
+	    CPU_SET (i, &cpus);
+	}
+    }
+    if (0 != sched_setaffinity (0, sizeof (cpus), &cpus)) {
+	perror ("low-jitter mode: sched_setaffinity");
+    }
+    if (0 < LOW_JITTER_FIFO_PRIO) {
+	param.sched_priority = LOW_JITTER_FIFO_PRIO;
+	if (0 != sched_setscheduler (0, SCHED_FIFO, &param)) {
+	    perror ("low-jitter mode: sched_setscheduler");
+	}
+    }
+
+    /* 
+     * Lock current and future pages, then touch the ones that the loop
+     * would otherwise fault in as it first draws each room.
+     */
+    if (0 != mlockall (MCL_CURRENT | MCL_FUTURE)) {
+	perror ("low-jitter mode: mlockall");
+    }
+    prefault_world ();
+    prefault_build_buffer ();
+    if (USE_ROOM_VIEW_CACHE) {
+	for (i = 0; ROOM_VIEW_SLOTS > i; i++) {
+	    if (NULL == room_view[i].img) {
+		room_view[i].img = malloc (VIEW_SAVE_SIZE);
+	    }
+	    if (NULL != room_view[i].img) {
+		prefault_pages (room_view[i].img, VIEW_SAVE_SIZE);
+	    }
+	}
+    }
+    prefault_pages (stack, sizeof (stack));
+}
+
+
+/* 
+ * account_tick
+ *   DESCRIPTION: Close the budget for the tick(s) just ended and adjust
+ *                the rendering quality level.  Sustained overruns lower 
+ *                the quality by one level at a time; sustained headroom
+ *                raises it again.
+ *   INPUTS: expired -- number of ticks since the previous call (more 
+ *                      than one if ticks were missed)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: updates degrade (and resets its busy time)
+ */
+static void
+account_tick (uint64_t expired)
+{
+    degrade.ticks += expired;
+    if (1 < expired || 
+        TICK_USEC * OVERRUN_PCT / 100 < degrade.busy_usec) {
+	degrade.overruns++;
+	degrade.missed_ticks += expired - 1;
+	degrade.run = (0 < degrade.run ? degrade.run + 1 : 1);
+	if (DEGRADE_TICKS <= degrade.run &&
+	    NUM_DEGRADE_LEVELS - 1 > degrade.level) {
+	    degrade.level++;
+	    if (DEGRADE_NO_OBJECTS == degrade.level &&
+	        !object_overlay_saves ()) {
+		degrade.level++;
+	    }
+	    degrade.level_changes++;
+	    if (degrade.max_level < degrade.level) {
+		degrade.max_level = degrade.level;
+	    }
+	    degrade.run = 0;
+	}
+    } else if (TICK_USEC * HEADROOM_PCT / 100 > degrade.busy_usec) {
+	degrade.run = (0 > degrade.run ? degrade.run - 1 : -1);
+	if (-RECOVER_TICKS >= degrade.run && DEGRADE_NONE < degrade.level) {
+	    degrade.level--;
+	    if (DEGRADE_NO_OBJECTS == degrade.level &&
+	        !object_overlay_saves ()) {
+		degrade.level--;
+	    }
+	    degrade.level_changes++;
+	    degrade.run = 0;
+	}
+    } else {
+	degrade.run = 0;
+    }
+    degrade.busy_usec = 0;
+}
+
+
 /* 
  * redraw_room
  *   DESCRIPTION: Draw all lines on the screen.
@@ -611,6 +1154,9 @@ redraw_room ()
 {
     int32_t i; /* index over rows */
 
+    /* Account for any objects that have moved since the room was drawn. */
+    refresh_room ();
+
     /* Draw all lines in the scroll region. */
     for (i = 0; i < SCROLL_Y_DIM; i++) {
 	(void)draw_horiz_line (i);
@@ -619,91 +1165,175 @@ redraw_room ()
 
 
 /* 
- * status_thread
- *   DESCRIPTION: Function executed by status message helper thread.
- *                Waits for a message to be displayed, then shows the
- *                message for 1.5 seconds before deleting it.  If a
- *                new message has appeared in the meantime, restarts the
- *                clock and tries again.
- *   INPUTS: none (ignored)
+ * draw_room_entry
+ *   DESCRIPTION: Prepare the palette and draw the (0,0) view of the room
+ *                that the player has just entered.  If a cached image of
+ *                that view is current, it is copied into the build buffer;
+ *                otherwise, the room is drawn line by line and the result
+ *                is cached, replacing the oldest cached room if necessary.
+ *                The time taken is recorded in entry_stats.
+ *   INPUTS: none
  *   OUTPUTS: none
- *   RETURN VALUE: NULL
- *   SIDE EFFECTS: Changes the status message to an empty string.
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws the entire screen (but not the status bar); may
+ *                 allocate memory for a cached view; turns the object 
+ *                 overlay on if the room is drawn
  */
-static void*
-status_thread (void* ignore)
+static void
+draw_room_entry ()
 {
-    struct timespec ts; /* absolute wake-up time */
-
-    while (1) {
-
-	/* 
-	 * Wait for a message to appear.  Note that we must check the
-	 * condition after acquiring the lock, and that pthread_cond_wait
-	 * yields the lock, then reacquires the lock before returning.
-	 */
-	(void)pthread_mutex_lock (&msg_lock);
-	while ('\0' == status_msg[0]) {
-	    pthread_cond_wait (&msg_cv, &msg_lock);
+    struct timeval start, end; /* times before and after drawing */
+    room_view_t* rv;           /* cache slot for the room        */
+    unsigned long usec;        /* time taken in microseconds     */
+    int i;                     /* loop index over cache slots    */
+
+    (void)gettimeofday (&start, NULL);
+
+    /* Adjust colors and photo drawing for the current room photo. */
+    prep_room (game_info.where);
+
+    /* Find the room's slot, or choose one to replace. */
+    rv = NULL;
+    for (i = 0; ROOM_VIEW_SLOTS > i; i++) {
+	if (game_info.where == room_view[i].room) {
+	    rv = &room_view[i];
+	    break;
 	}
+    }
 
+    if (USE_ROOM_VIEW_CACHE && NULL != rv && 
+        room_version (game_info.where) == rv->version &&
+	0 == restore_view (rv->img)) {
+	entry_stats.cache_hits++;
+    } else {
 	/* 
-	 * A message is present: if we stop before the timeout
-	 * passes, assume that a new one has been posted; if the
-	 * timeout passes, clear the message and wait for a new one.
+	 * Draw the objects even if the overlay is off (the canvas may be
+	 * unavailable), as the view drawn here is cached.
 	 */
-	do {
-	    /* Get the current time. */
-	    clock_gettime (CLOCK_REALTIME, &ts);
-	    
-	    /* Add 1.5 seconds to it. */
-	    if (500000000 <= ts.tv_nsec) {
-		ts.tv_sec += 2;
-		ts.tv_nsec -= 500000000;
+	(void)set_object_overlay (1);
+	redraw_room ();
+	if (USE_ROOM_VIEW_CACHE) {
+	    if (NULL == rv) {
+		rv = &room_view[next_view_slot];
+		next_view_slot = (next_view_slot + 1) % ROOM_VIEW_SLOTS;
+	    }
+	    if (NULL == rv->img) {
+		rv->img = malloc (VIEW_SAVE_SIZE);
+	    }
+	    if (NULL != rv->img && 0 == save_view (rv->img)) {
+		rv->room = game_info.where;
+		rv->version = room_version (game_info.where);
 	    } else {
-		ts.tv_sec += 1;
-		ts.tv_nsec += 500000000;
+		rv->room = NULL;
 	    }
+	}
+    }
 
-	    /* 
-	     * And go to sleep.  If we wake up due to anything but a
-	     * timeout, we assume (possibly incorrectly) that a new
-	     * message has appeared and try to wait 1.5 seconds again.
-	     */
-	} while (ETIMEDOUT != 
-		 pthread_cond_timedwait (&msg_cv, &msg_lock, &ts));
+    (void)gettimeofday (&end, NULL);
+    usec = (end.tv_sec - start.tv_sec) * 1000000 + 
+	   (end.tv_usec - start.tv_usec);
+    entry_stats.entries++;
+    entry_stats.total_usec += usec;
+    if (entry_stats.max_usec < usec) {
+	entry_stats.max_usec = usec;
+    }
+}
 
-	/* 
-	 * Clear the message, then release the lock (remember that 
-	 * pthread_cond_timedwait reacquires the lock before returning).
-	 */
-	status_msg[0] = '\0';
-	(void)pthread_mutex_unlock (&msg_lock);
+
+/* 
+ * publish_status
+ *   DESCRIPTION: Replace the status message, making the change visible
+ *                to readers of the status slot.  The caller must be the
+ *                slot's only writer.
+ *   INPUTS: s -- the new message (truncated to STATUS_MSG_LEN characters)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: advances status_slot.seq by two
+ */
+static void
+publish_status (const char* s)
+{
+    uint32_t seq = status_slot.seq; /* only we write seq */
+
+    /* Mark the write in progress before touching the message. */
+    __atomic_store_n (&status_slot.seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+
+    strncpy (status_slot.msg, s, STATUS_MSG_LEN);
+    status_slot.msg[STATUS_MSG_LEN] = '\0';
+
+    /* Publish the message. */
+    __atomic_store_n (&status_slot.seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+
+/* 
+ * read_status
+ *   DESCRIPTION: Copy the current status message without locking.  If the
+ *                slot's sequence number equals seen, buf already holds 
+ *                the current message and nothing is copied.
+ *   INPUTS: seen -- sequence number returned by the previous call (any
+ *                   odd number forces a copy)
+ *   OUTPUTS: buf -- the current status message
+ *   RETURN VALUE: sequence number of the message in buf
+ *   SIDE EFFECTS: none
+ */
+static uint32_t
+read_status (char buf[STATUS_MSG_LEN + 1], uint32_t seen)
+{
+    uint32_t seq; /* sequence number before copying */
+
+    while (1) {
+	seq = __atomic_load_n (&status_slot.seq, __ATOMIC_ACQUIRE);
+	if (seq == seen) {
+	    return seq;
+	}
+	if (0 != (seq & 1)) {
+	    continue;  /* write in progress */
+	}
+	memcpy (buf, status_slot.msg, STATUS_MSG_LEN + 1);
+	__atomic_thread_fence (__ATOMIC_ACQUIRE);
+	if (__atomic_load_n (&status_slot.seq, __ATOMIC_RELAXED) == seq) {
+	    buf[STATUS_MSG_LEN] = '\0';
+	    return seq;
+	}
     }
+}
 
-    /* This code never executes--the thread should always be cancelled. */
-    return NULL;
+
+/* 
+ * expire_status
+ *   DESCRIPTION: Clear the status message.  Called by status_timer once
+ *                a message has been shown for STATUS_MSG_TICKS.
+ *   INPUTS: none (ignored)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: clears the status message
+ */
+static void
+expire_status (void* ignore)
+{
+    publish_status ("");
 }
 
 
 /* 
- * time_is_after 
- *   DESCRIPTION: Check whether one time is at or after a second time.
- *   INPUTS: t1 -- the first time
- *           t2 -- the second time
+ * update_tux_time
+ *   DESCRIPTION: Show the time elapsed since the start of the game on the
+ *                Tux controller, then reschedule for one second later.
+ *   INPUTS: none (ignored)
  *   OUTPUTS: none
- *   RETURN VALUE: 1 if t1 >= t2
- *                 0 if t1 < t2
- *   SIDE EFFECTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the controller's display
  */
-static int
-time_is_after (struct timeval* t1, struct timeval* t2)
+static void
+update_tux_time (void* ignore)
 {
-    if (t1->tv_sec == t2->tv_sec)
-        return (t1->tv_usec >= t2->tv_usec);
-    if (t1->tv_sec > t2->tv_sec)
-        return 1;
-    return 0;
+    struct timespec now; /* current time */
+
+    (void)clock_gettime (CLOCK_MONOTONIC, &now);
+    display_time_on_tux (now.tv_sec - game_start_time.tv_sec);
+    timer_add (&game_timers, &tux_time_timer, TUX_TIME_TICKS);
 }
 
 
@@ -719,21 +1349,9 @@ time_is_after (struct timeval* t1, struct timeval* t2)
 void
 show_status (const char* s)
 {
-    /* msg_lock critical section starts here. */
-    (void)pthread_mutex_lock (&msg_lock);
-
-    /* Copy the new message under the protection of msg_lock. */
-    strncpy (status_msg, s, STATUS_MSG_LEN);
-    status_msg[STATUS_MSG_LEN] = '\0';
-
-    /* 
-     * Wake up the status message helper thread.  Note that we still hold
-     * the msg_lock, so the thread can't wake up until we release it.
-     */
-    (void)pthread_cond_signal (&msg_cv);
-
-    /* msg_lock critical section ends here. */
-    (void)pthread_mutex_unlock (&msg_lock);
+    /* Show the message for STATUS_MSG_TICKS, starting over if need be. */
+    publish_status (s);
+    timer_add (&game_timers, &status_timer, STATUS_MSG_TICKS);
 }
 
 
@@ -747,7 +1365,9 @@ show_status (const char* s)
 int
 main ()
 {
-    game_condition_t game;  /* outcome of playing */
+    game_condition_t game;  /* outcome of playing              */
+    present_stats_t  ps;    /* frame presentation statistics   */
+    palette_stats_t  pal;   /* palette upload statistics       */
 
     /* Randomize for more fun (remove for deterministic layout). */
     srand (time (NULL));
@@ -763,29 +1383,29 @@ main ()
 	PANIC ("failed sanity checks");
     }
 
-    /* Create status message thread. */
-    if (0 != pthread_create (&status_thread_id, NULL, status_thread, NULL)) {
-        PANIC ("failed to create status thread");
+    /* Pin, lock, and prefault the game if asked. */
+    if (USE_LOW_JITTER) {
+	enter_low_jitter_mode ();
     }
 
-    		push_cleanup (cancel_status_thread, NULL);
-    		{
+    /* Start mode X. */
+    if (0 != set_mode_X (fill_horiz_buffer, fill_vert_buffer)) {
+	PANIC ("cannot initialize mode X");
+    }
+    push_cleanup ((cleanup_fn_t)clear_mode_X, NULL); {
 
-	/* Start mode X. */
-	if (0 != set_mode_X (fill_horiz_buffer, fill_vert_buffer)) {
-	    PANIC ("cannot initialize mode X");
+	/* Synchronize presentation with the vertical retrace if asked. */
+	if (0 != set_vsync_mode (PRESENT_VSYNC)) {
+	    PANIC ("cannot set vsync mode");
 	}
-	push_cleanup ((cleanup_fn_t)clear_mode_X, NULL); {
-
-	    /* Initialize the keyboard and/or Tux controller. */
-	    if (0 != init_input ()) {
-		PANIC ("cannot initialize input");
-	    }
-	    push_cleanup ((cleanup_fn_t)shutdown_input, NULL); {
 
-		game = game_loop ();
+	/* Initialize the keyboard and/or Tux controller. */
+	if (0 != init_input ()) {
+	    PANIC ("cannot initialize input");
+	}
+	push_cleanup ((cleanup_fn_t)shutdown_input, NULL); {
 
-	    } pop_cleanup (1);
+	    game = game_loop ();
 
 	} pop_cleanup (1);
 
@@ -799,6 +1419,50 @@ main ()
 	case GAME_QUIT: printf ("Quitter!\n"); break;
     }
 
+    /* Report how well frames met their retrace deadlines. */
+    if (VSYNC_OFF != PRESENT_VSYNC) {
+	get_present_stats (&ps);
+	printf ("%lu frames, %lu late, %lu retraces missed (%lu usec "
+		"period); lateness avg %lu usec, max %lu usec\n", 
+		ps.frames, ps.late_frames, ps.missed_retraces, ps.retrace_usec,
+		(0 == ps.frames ? 0 : ps.total_late_usec / ps.frames),
+		ps.max_late_usec);
+    }
+
+    /* Report screen updates shown and skipped (if the loop fell behind). */
+    printf ("%lu screens presented at up to %d Hz, %lu updates dropped\n",
+	    presents, PRESENT_HZ, dropped_presents);
+
+    /* Report tick overruns and the rendering quality they forced. */
+    printf ("%lu of %lu ticks overran (%lu missed); quality level %d "
+	    "(worst %d, %lu changes)\n", degrade.overruns, degrade.ticks,
+	    degrade.missed_ticks, degrade.level, degrade.max_level, 
+	    degrade.level_changes);
+
+    /* Report how late the loop woke up for ticks. */
+    printf ("tick wakeups late avg %lu usec, max %lu usec; %lu over "
+	    "100 usec, %lu over 1 msec (low-jitter mode %s)\n", 
+	    (0 == jitter.samples ? 0 : jitter.total_usec / jitter.samples),
+	    jitter.max_usec, jitter.over_100us, jitter.over_1ms,
+	    (USE_LOW_JITTER ? "on" : "off"));
+
+    /* Report room transition latency. */
+    printf ("%lu room entries, %lu from cache; latency avg %lu usec, "
+	    "max %lu usec\n", entry_stats.entries, entry_stats.cache_hits,
+	    (0 == entry_stats.entries ? 0 : 
+	     entry_stats.total_usec / entry_stats.entries),
+	    entry_stats.max_usec);
+
+    /* Report the cost of palette changes between rooms. */
+    get_palette_stats (&pal);
+    printf ("%lu room changes, %lu DAC bytes in %lu ranges (%lu avg, "
+	    "%lu last)\n", pal.room_changes, pal.dac_bytes, pal.dac_ranges,
+	    (0 == pal.room_changes ? 0 : pal.dac_bytes / pal.room_changes),
+	    pal.last_dac_bytes);
+
+    /* Report traffic to the Tux controller. */
+    report_tux_stats ();
+
     /* Return success. */
     return 0;
 }
@@ -50,8 +50,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/io.h>
+#include <sys/mman.h>
 #include <termio.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "assert.h"
@@ -64,6 +66,26 @@
 /* set to 1 to use tux controller; otherwise, uses keyboard input */
 #define USE_TUX_CONTROLLER 1
 
+/* 
+ * set to 1 to let the Tux controller's own clock show the elapsed time
+ * (see TUX_SET_CLOCK), so that no LED updates are sent during play;
+ * otherwise, the time is sent to the LEDs once a second 
+ */
+#define USE_TUX_CLOCK 1
+
+/* 
+ * set to 1 to put the Tux controller into mouse mode, in which its 
+ * movement scrolls the view by TUX_MOUSE_GAIN pixels per count
+ */
+#define USE_TUX_MOUSE 0
+#define TUX_MOUSE_GAIN 2
+
+/* 
+ * the Tux controller's serial port; the TUX_TTY environment variable, if
+ * set, names another (such as the pseudo-terminal of module/tux-emu)
+ */
+#define TUX_TTY_DEFAULT "/dev/ttyS0"
+
 /* variable ot indicate 0 in hex */
 #define NOTHING 0x0
 /* stores original terminal settings */
@@ -71,6 +93,46 @@ static struct termios tio_orig;
 static int fd;
 static int prev_time;
 
+/* 
+ * The input event queue holds every command and typed character read 
+ * from the input devices, in order, until the game retrieves it with
+ * get_input_event.  It is a ring of INPUT_QUEUE_LEN entries, of which
+ * n_queued starting at q_head are in use.
+ */
+#define INPUT_QUEUE_LEN 256
+typedef struct queued_input_t queued_input_t;
+struct queued_input_t {
+    cmd_t cmd;             /* command, or CMD_NONE for typed character */
+    char ch;               /* typed character                          */
+    int dx, dy;            /* pixels to scroll, for CMD_SCROLL         */
+    struct timespec time;  /* time at which input was read             */
+};
+static queued_input_t input_queue[INPUT_QUEUE_LEN];
+static int q_head;
+static int n_queued;
+
+/* 
+ * Tux controller button state (active low, as reported by the driver)
+ * after the last button event read from the driver's event queue.
+ */
+static unsigned char tux_buttons = 0xFF;
+
+/* 
+ * The driver's state page for the controller (NULL if it could not be
+ * mapped), and the sequence number of the next event to be read.  While
+ * the page shows no new events, polling the controller needs no system
+ * call.
+ */
+static const volatile struct tux_state* tux_state = NULL;
+static unsigned int tux_next_seq = 0;
+static unsigned int tux_mouse_packets = 0;
+
+static void map_tux_state ();
+static void read_tux_state (struct tux_state* st);
+static cmd_t tux_button_cmd (unsigned char buttons);
+static void poll_tux (const struct timespec* now, int tick);
+static void poll_tux_mouse (const struct timespec* now);
+
 /* 
  * init_input
  *   DESCRIPTION: Initializes the input controller.  As both keyboard and
@@ -80,13 +142,15 @@ static int prev_time;
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: 0 on success, -1 on failure 
- *   SIDE EFFECTS: changes terminal settings on stdin; prints an error
- *                 message on failure
+ *   SIDE EFFECTS: changes terminal settings on stdin; opens and sets up
+ *                 the Tux controller's tty (see TUX_TTY_DEFAULT); prints
+ *                 an error message on failure
  */
 int
 init_input ()
 {
     struct termios tio_new;
+    const char* tux_tty; /* path of the Tux controller's tty */
 
     /*
      * Set non-blocking mode so that stdin can be read without blocking
@@ -121,15 +185,23 @@ init_input ()
 
     /* Return success. */
     prev_time = 0;
-    fd = open("/dev/ttyS0", O_RDWR | O_NOCTTY);
+    if (NULL == (tux_tty = getenv ("TUX_TTY"))) {
+	tux_tty = TUX_TTY_DEFAULT;
+    }
+    fd = open(tux_tty, O_RDWR | O_NOCTTY);
 	int ldisc_num = N_MOUSE;
 	ioctl(fd, TIOCSETD, &ldisc_num);
 	ioctl(fd, TUX_INIT);
+	if (USE_TUX_MOUSE != 0) {
+	    ioctl (fd, TUX_SET_MOUSE, 1UL);
+	}
+	map_tux_state ();
 	printf("init input\n");
     return 0;
 }
 
 static char typing[MAX_TYPED_LEN + 1] = {'\0'};
+static void typed_a_char (char c);
 
 const char*
 get_typed_command ()
@@ -166,32 +238,120 @@ typed_a_char (char c)
 }
 
 /* 
- * get_command
- *   DESCRIPTION: Reads a command from the input controller.  As some
- *                controllers provide only absolute input (e.g., go
- *                right), the current direction is needed as an input
- *                to this routine.
- *   INPUTS: cur_dir -- current direction of motion
+ * get_input_fds
+ *   DESCRIPTION: Get the file descriptors from which get_command reads, so
+ *                that the caller can sleep until input arrives: stdin,
+ *                and the Tux controller's serial port if it is in use
+ *                and open.  The controller's tty becomes readable when
+ *                the driver has queued button events.
+ *   INPUTS: max -- maximum number of descriptors to return
+ *   OUTPUTS: fds -- the descriptors
+ *   RETURN VALUE: the number of descriptors written to fds
+ *   SIDE EFFECTS: none
+ */
+int
+get_input_fds (int fds[], int max)
+{
+    int n = 0;
+
+    if (n < max) {
+	fds[n++] = fileno (stdin);
+    }
+#if (USE_TUX_CONTROLLER != 0)
+    if (n < max && 0 <= fd) {
+	fds[n++] = fd;
+    }
+#endif
+    return n;
+}
+
+/* 
+ * enqueue_input
+ *   DESCRIPTION: Add a command or a typed character to the tail of the
+ *                input event queue.  The caller must ensure that the
+ *                queue is not full.
+ *   INPUTS: cmd -- the command, or CMD_NONE for a typed character
+ *           ch -- the typed character (ignored unless cmd is CMD_NONE)
+ *           t -- the time at which the input was read
  *   OUTPUTS: none
- *   RETURN VALUE: command issued by the input controller
- *   SIDE EFFECTS: drains any keyboard input
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: adds an entry to the input queue
  */
-cmd_t 
-get_command ()
+static void
+enqueue_input (cmd_t cmd, char ch, const struct timespec* t)
+{
+    queued_input_t* q = &input_queue[(q_head + n_queued) % INPUT_QUEUE_LEN];
+
+    q->cmd = cmd;
+    q->ch = ch;
+    q->dx = 0;
+    q->dy = 0;
+    q->time = *t;
+    n_queued++;
+}
+
+
+/* 
+ * enqueue_scroll
+ *   DESCRIPTION: Add a CMD_SCROLL by a number of pixels to the tail of 
+ *                the input event queue.  The caller must ensure that the
+ *                queue is not full.
+ *   INPUTS: dx -- pixels to scroll to the right (negative for left)
+ *           dy -- pixels to scroll down (negative for up)
+ *           t -- the time at which the input was read
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: adds an entry to the input queue
+ */
+static void
+enqueue_scroll (int dx, int dy, const struct timespec* t)
+{
+    enqueue_input (CMD_SCROLL, 0, t);
+    input_queue[(q_head + n_queued - 1) % INPUT_QUEUE_LEN].dx = dx;
+    input_queue[(q_head + n_queued - 1) % INPUT_QUEUE_LEN].dy = dy;
+}
+
+/* 
+ * poll_input
+ *   DESCRIPTION: Read all available keystrokes and Tux controller 
+ *                button events and movement, adding every command and typed
+ *                character to the input event queue with the time at
+ *                which it was read.  Input that does not fit in the
+ *                queue is left unread for the next call.
+ *   INPUTS: tick -- non-zero if a simulation tick has passed since the
+ *                   previous call
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: drains keyboard input (up to the space in the queue)
+ */
+void
+poll_input (int tick)
 {
 #if (USE_TUX_CONTROLLER == 0) /* use keyboard control with arrow keys */
     static int state = 0;             /* small FSM for arrow keys */
 #endif
-    static cmd_t command = CMD_NONE;
+    unsigned char keys[INPUT_QUEUE_LEN]; /* keystrokes read             */
+    struct timespec now;                 /* time of reading             */
     cmd_t pushed = CMD_NONE;
+    int n_keys;                          /* number of keystrokes read   */
+    int i;                               /* loop index over keystrokes  */
     int ch;
 
-    /* Read all characters from stdin. */
-    while ((ch = getc (stdin)) != EOF) {
+    (void)clock_gettime (CLOCK_MONOTONIC, &now);
+
+    /* 
+     * Read as many characters from stdin as the queue can hold (each
+     * produces at most one queue entry).
+     */
+    n_keys = read (fileno (stdin), keys, INPUT_QUEUE_LEN - n_queued);
+    for (i = 0; n_keys > i; i++) {
+	ch = keys[i];
 
 	/* Backquote is used to quit the game. */
-	if (ch == '`')
-	    return CMD_QUIT;
+	if (ch == '`') {
+	    enqueue_input (CMD_QUIT, 0, &now);
+	    continue;
+	}
 	
 #if (USE_TUX_CONTROLLER == 0) /* use keyboard control with arrow keys */
 	/*
@@ -207,7 +367,7 @@ get_command ()
 	        if (27 == ch) {
 		    state = 1;
 		} else if (valid_typing (ch)) {
-		    typed_a_char (ch);
+		    enqueue_input (CMD_NONE, ch, &now);
 		} else if (10 == ch || 13 == ch) {
 		    pushed = CMD_TYPED;
 		}
@@ -222,7 +382,7 @@ get_command ()
 			 * Note that we may be discarding an ESC (27), but
 			 * we don't use that as typed input anyway.
 			 */
-			typed_a_char (ch);
+			enqueue_input (CMD_NONE, ch, &now);
 		    } else if (10 == ch || 13 == ch) {
 			pushed = CMD_TYPED;
 		    }
@@ -252,7 +412,7 @@ get_command ()
 			 * a bracket (91), but we don't use either as 
 			 * typed input anyway.
 			 */
-			typed_a_char (ch);
+			enqueue_input (CMD_NONE, ch, &now);
 		    } else if (10 == ch || 13 == ch) {
 			pushed = CMD_TYPED;
 		    }
@@ -263,7 +423,7 @@ get_command ()
 	        if ('~' == ch) {
 		    /* Consume it silently. */
 		} else if (valid_typing (ch)) {
-		    typed_a_char (ch);
+		    enqueue_input (CMD_NONE, ch, &now);
 		} else if (10 == ch || 13 == ch) {
 		    pushed = CMD_TYPED;
 		}
@@ -272,61 +432,291 @@ get_command ()
 #else /* USE_TUX_CONTROLLER */
 	/* Tux controller mode; still need to support typed commands. */
 	if (valid_typing (ch)) {
-	    typed_a_char (ch);
+	    enqueue_input (CMD_NONE, ch, &now);
 	} else if (10 == ch || 13 == ch) {
 	    pushed = CMD_TYPED;
 	}
 #endif /* USE_TUX_CONTROLLER */
+	if (CMD_NONE != pushed) {
+	    enqueue_input (pushed, 0, &now);
+	    pushed = CMD_NONE;
+	}
+    }
+
+    if (USE_TUX_CONTROLLER != 0) {
+	poll_tux (&now, tick);
+	if (USE_TUX_MOUSE != 0) {
+	    poll_tux_mouse (&now);
+	}
+    }
 }
-	if (USE_TUX_CONTROLLER != 0)
-	{
-		/* add tux support */
-		unsigned char button_press = 0;
-		ioctl(fd, TUX_BUTTONS, &button_press);
-		/* use a switch statement to determine the command to issue depending on the button */
-		switch(button_press)
-		{
-			case 0xFE:
-				pushed = CMD_QUIT;
-				//printf("Start\n");
-				break;
-			case 0xFD:
-				pushed = CMD_MOVE_LEFT;
-				//printf("A\n");
-				break;
-			case 0xFB:
-				pushed = CMD_ENTER;
-				//printf("B\n");
-				break;
-			case 0xF7:
-				pushed = CMD_MOVE_RIGHT;
-				//printf("C\n");
-				break;
-			case 0xEF:
-				pushed = CMD_UP;
-				break;
-			case 0xDF:
-				pushed = CMD_LEFT;
-				break;
-			case 0xBF:
-				pushed = CMD_DOWN;
-				break;
-			case 0x7F:
-				pushed = CMD_RIGHT;
-				break;
-			default:
-				pushed = CMD_NONE;
-		}
+
+/* 
+ * map_tux_state
+ *   DESCRIPTION: Map the Tux controller driver's state page for the
+ *                controller read-only.  If this fails, the controller is
+ *                polled with system calls instead.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: sets tux_state
+ */
+static void
+map_tux_state ()
+{
+    unsigned long offset; /* offset of the page in the state device */
+    int state_fd;         /* the state device                       */
+    void* page;           /* the mapped page                        */
+
+    if (0 > fd || 0 != ioctl (fd, TUX_GET_STATE_OFFSET, &offset)) {
+	return;
+    }
+    if (0 > (state_fd = open (TUX_STATE_DEVICE, O_RDONLY))) {
+	return;
+    }
+    page = mmap (NULL, sysconf (_SC_PAGESIZE), PROT_READ, MAP_SHARED,
+		 state_fd, offset);
+    (void)close (state_fd);
+    if (MAP_FAILED != page) {
+	tux_state = page;
+    }
+}
+
+
+/* 
+ * read_tux_state
+ *   DESCRIPTION: Copy the controller state from the driver's state page,
+ *                retrying while the driver is changing it (see the 
+ *                sequence lock in tuxctl-ioctl.h).
+ *   INPUTS: none
+ *   OUTPUTS: st -- a consistent copy of the state
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+read_tux_state (struct tux_state* st)
+{
+    unsigned int seq; /* sequence count before copying */
+
+    do {
+	seq = tux_state->seq;
+	__sync_synchronize ();
+	st->event_seq = tux_state->event_seq;
+	st->buttons = tux_state->buttons;
+	st->led = tux_state->led;
+	st->time_ns = tux_state->time_ns;
+	st->mouse_packets = tux_state->mouse_packets;
+	__sync_synchronize ();
+    } while (0 != (seq & 1) || seq != tux_state->seq);
+    st->seq = seq;
+}
+
+
+/* 
+ * tux_button_cmd
+ *   DESCRIPTION: Map a Tux controller button state to a command.  Only
+ *                states with a single button down issue commands.
+ *   INPUTS: buttons -- the button state (active low)
+ *   OUTPUTS: none
+ *   RETURN VALUE: the command, or CMD_NONE
+ *   SIDE EFFECTS: none
+ */
+static cmd_t
+tux_button_cmd (unsigned char buttons)
+{
+    switch (buttons) {
+	case 0xFE: return CMD_QUIT;       /* start */
+	case 0xFD: return CMD_MOVE_LEFT;  /* A     */
+	case 0xFB: return CMD_ENTER;      /* B     */
+	case 0xF7: return CMD_MOVE_RIGHT; /* C     */
+	case 0xEF: return CMD_UP;
+	case 0xDF: return CMD_LEFT;
+	case 0xBF: return CMD_DOWN;
+	case 0x7F: return CMD_RIGHT;
+	default:   return CMD_NONE;
+    }
+}
+
+/* 
+ * poll_tux
+ *   DESCRIPTION: Drain the Tux controller driver's queue of button events
+ *                (in batches), adding a command to the input queue for 
+ *                each button press, stamped with the time at which the
+ *                driver received it; presses released before this call 
+ *                are thus not missed.  If no button was pressed and a
+ *                tick has passed, a button still held down issues its
+ *                command again, so that holding a button repeats it once
+ *                per tick however often the screen is updated.
+ *                If the driver's state page is mapped and shows no new
+ *                events, the driver is not called at all.
+ *   INPUTS: now -- the time of this call
+ *           tick -- non-zero if a tick has passed since the last call
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: reads events from the driver; adds entries to the
+ *                 input queue (events that do not fit are left queued
+ *                 in the driver)
+ */
+static void
+poll_tux (const struct timespec* now, int tick)
+{
+    struct tux_event_batch batch; /* events read from the driver */
+    struct tux_state st;          /* copy of driver state page   */
+    struct timespec t;            /* time of an event            */
+    int pressed = 0;              /* a press has been queued     */
+    cmd_t cmd;                    /* command for a button state  */
+    unsigned int i;               /* loop index over events      */
+
+    if (0 > fd) {
+	return;
+    }
+    if (NULL != tux_state) {
+	read_tux_state (&st);
+	batch.count = (tux_next_seq == st.event_seq ? 0 : TUX_EVENT_BATCH);
+    } else {
+	batch.count = TUX_EVENT_BATCH;
+    }
+    while (TUX_EVENT_BATCH == batch.count) {
+	batch.count = INPUT_QUEUE_LEN - n_queued;
+	if (TUX_EVENT_BATCH < batch.count) {
+	    batch.count = TUX_EVENT_BATCH;
 	}
+	if (0 == batch.count || 0 != ioctl (fd, TUX_READ_EVENTS, &batch)) {
+	    break;
+	}
+	for (i = 0; batch.count > i; i++) {
+	    /* a button is pressed when its bit goes from 1 to 0 */
+	    if (0 != (tux_buttons & ~batch.ev[i].buttons) &&
+	        CMD_NONE != (cmd = tux_button_cmd (batch.ev[i].buttons))) {
+		t.tv_sec = batch.ev[i].time_ns / 1000000000ULL;
+		t.tv_nsec = batch.ev[i].time_ns % 1000000000ULL;
+		enqueue_input (cmd, 0, &t);
+		pressed = 1;
+	    }
+	    tux_buttons = batch.ev[i].buttons;
+	    tux_next_seq = batch.ev[i].seq + 1;
+	}
+    }
 
-    /*
-     * Once a direction is pushed, that command remains active
-     * until a turn is taken.
-     */
-    if (pushed == CMD_NONE) {
-        command = CMD_NONE;
+    if (!pressed && tick && INPUT_QUEUE_LEN > n_queued &&
+        CMD_NONE != (cmd = tux_button_cmd (tux_buttons))) {
+	enqueue_input (cmd, 0, now);
+    }
+}
+
+/* 
+ * poll_tux_mouse
+ *   DESCRIPTION: Read the movement that the Tux controller has reported
+ *                in mouse mode since the last call, and add a CMD_SCROLL
+ *                for it (TUX_MOUSE_GAIN pixels per count) to the input
+ *                queue.  If the driver's state page is mapped and shows
+ *                no new movement, the driver is not called.
+ *   INPUTS: now -- the time of this call
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: reads movement from the driver; may add an entry to 
+ *                 the input queue (movement is left in the driver if
+ *                 the queue is full)
+ */
+static void
+poll_tux_mouse (const struct timespec* now)
+{
+    struct tux_state st;  /* copy of driver state page */
+    struct tux_mouse m;   /* movement from the driver  */
+
+    if (0 > fd || INPUT_QUEUE_LEN == n_queued) {
+	return;
+    }
+    if (NULL != tux_state) {
+	read_tux_state (&st);
+	if (tux_mouse_packets == st.mouse_packets) {
+	    return;
+	}
+    }
+    if (0 != ioctl (fd, TUX_READ_MOUSE, &m)) {
+	return;
+    }
+    tux_mouse_packets = m.packets;
+    /* the mouse reports upward movement as positive */
+    if (0 != m.dx || 0 != m.dy) {
+	enqueue_scroll (m.dx * TUX_MOUSE_GAIN, -m.dy * TUX_MOUSE_GAIN, now);
     }
-    return pushed;
+}
+
+
+/* 
+ * get_input_event
+ *   DESCRIPTION: Remove the oldest command from the input event queue,
+ *                merging it with any immediately following identical
+ *                scroll commands (CMD_UP, CMD_DOWN, CMD_LEFT, CMD_RIGHT,
+ *                and CMD_SCROLL, whose distances are added up) so that
+ *                a burst of scrolling is handled as one move.
+ *                Typed characters that precede the command in the queue
+ *                are added to the typed command string on the way, so
+ *                a CMD_TYPED event sees exactly the characters typed 
+ *                before it.  Call poll_input to fill the queue.
+ *   INPUTS: none
+ *   OUTPUTS: ev -- the command, the number of commands merged into it,
+ *                  the distance to scroll (for CMD_SCROLL), and the 
+ *                  time at which the first of them was read
+ *   RETURN VALUE: 1 if a command was returned, or 0 if the queue is empty
+ *   SIDE EFFECTS: removes entries from the input queue; may change the
+ *                 typed command string
+ */
+int
+get_input_event (input_event_t* ev)
+{
+    queued_input_t* q;  /* entry at head of queue */
+
+    /* Apply typed characters until a command is found. */
+    while (0 < n_queued && CMD_NONE == input_queue[q_head].cmd) {
+	typed_a_char (input_queue[q_head].ch);
+	q_head = (q_head + 1) % INPUT_QUEUE_LEN;
+	n_queued--;
+    }
+    if (0 == n_queued) {
+	return 0;
+    }
+
+    /* Take the command, then merge identical scroll commands behind it. */
+    q = &input_queue[q_head];
+    ev->cmd = q->cmd;
+    ev->count = 1;
+    ev->dx = q->dx;
+    ev->dy = q->dy;
+    ev->time = q->time;
+    q_head = (q_head + 1) % INPUT_QUEUE_LEN;
+    n_queued--;
+    if (CMD_RIGHT == ev->cmd || CMD_LEFT == ev->cmd || 
+        CMD_UP == ev->cmd || CMD_DOWN == ev->cmd || CMD_SCROLL == ev->cmd) {
+	while (0 < n_queued && ev->cmd == input_queue[q_head].cmd) {
+	    ev->count++;
+	    ev->dx += input_queue[q_head].dx;
+	    ev->dy += input_queue[q_head].dy;
+	    q_head = (q_head + 1) % INPUT_QUEUE_LEN;
+	    n_queued--;
+	}
+    }
+    return 1;
+}
+
+/* 
+ * get_command
+ *   DESCRIPTION: Reads a command from the input controller: polls the
+ *                input devices, then returns the oldest queued command.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: command issued by the input controller, or CMD_NONE
+ *   SIDE EFFECTS: drains any keyboard input
+ */
+cmd_t 
+get_command ()
+{
+    input_event_t ev;
+
+    /* each call stands for a tick, so held buttons repeat per call */
+    poll_input (1);
+    return (get_input_event (&ev) ? ev.cmd : CMD_NONE);
 }
 
 /* 
@@ -348,7 +738,10 @@ shutdown_input ()
 /* 
  * display_time_on_tux
  *   DESCRIPTION: Show number of elapsed seconds as minutes:seconds
- *                on the Tux controller's 7-segment displays.
+ *                on the Tux controller's 7-segment displays.  With
+ *                USE_TUX_CLOCK, the first call starts the controller's
+ *                clock at num_seconds and later calls do nothing (unless
+ *                the driver refuses, in which case the LEDs are set).
  *   INPUTS: num_seconds -- total seconds elapsed so far
  *   OUTPUTS: none
  *   RETURN VALUE: none 
@@ -365,6 +758,16 @@ display_time_on_tux (int num_seconds)
 	unsigned int led_to_light = NOTHING;
 	int i;
 	unsigned int arg = NOTHING;
+#if (USE_TUX_CLOCK != 0)
+	static int clock_started = 0; /* the controller's clock is running */
+
+	if (clock_started)
+		return;
+	if (0 == ioctl(fd, TUX_SET_CLOCK, (unsigned long)num_seconds)) {
+		clock_started = 1;
+		return;
+	}
+#endif
 /* initialize the array to 0's */
 for (i = 0; i < 4; i++)
 {
@@ -420,6 +823,39 @@ if(num_seconds != prev_time)
 }
 
 
+/* 
+ * report_tux_stats
+ *   DESCRIPTION: Print the Tux controller driver's command pipeline
+ *                and receive counters (nothing when compiled for a
+ *                keyboard).
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: prints to stdout
+ */
+void
+report_tux_stats ()
+{
+#if (USE_TUX_CONTROLLER != 0)
+    struct tux_stats st; /* driver counters */
+
+    if (0 > fd || 0 != ioctl (fd, TUX_GET_STATS, &st)) {
+	return;
+    }
+    printf ("Tux: %u commands sent, %u ACKs (%u timed out), %u dropped, "
+	    "%u retried; %u LED updates: %u sent, %u coalesced, %u skipped;"
+	    " queue depth %u (max %u)\n", st.cmds_sent, st.acks, 
+	    st.ack_timeouts, st.cmds_dropped, st.tx_full, st.led_requests, 
+	    st.led_sent, st.led_coalesced, st.led_skipped, st.queue_depth, 
+	    st.max_queue_depth);
+    printf ("Tux: %u packets received, %u framing errors, %u resyncs, "
+	    "%u bytes overrun, %u bytes lost sending; %u animation frames\n",
+	    st.rx_packets, st.rx_framing_errors, st.rx_resyncs,
+	    st.rx_overruns, st.tx_lost, st.anim_frames);
+#endif
+}
+
+
 #if (TEST_INPUT_DRIVER == 1)
 int
 main ()
@@ -428,7 +864,8 @@ main ()
     cmd_t cmd;
     static const char* const cmd_name[NUM_COMMANDS] = {
         "none", "right", "left", "up", "down", 
-	"move left", "enter", "move right", "typed command", "quit"
+	"move left", "enter", "move right", "typed command", "quit",
+	"scroll"
     };
 
     /* Grant ourselves permission to use ports 0-1023 */
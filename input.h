@@ -38,20 +38,54 @@
 #ifndef INPUT_H
 #define INPUT_H
 
+#include <time.h>
+
 /* possible commands from input device, whether keyboard or game controller */
 typedef enum {
     CMD_NONE, CMD_RIGHT, CMD_LEFT, CMD_UP, CMD_DOWN,
     CMD_MOVE_LEFT, CMD_ENTER, CMD_MOVE_RIGHT,
     CMD_TYPED,
     CMD_QUIT,
+    CMD_SCROLL,
     NUM_COMMANDS
 } cmd_t;
 
 #define MAX_TYPED_LEN 20
 
+/* 
+ * an input event: a command, the number of identical commands merged
+ * into it (for scrolling), and the time at which the first was read;
+ * CMD_SCROLL (from Tux controller mouse mode) instead scrolls by dx 
+ * pixels to the right and dy pixels down
+ */
+typedef struct input_event_t input_event_t;
+struct input_event_t {
+    cmd_t           cmd;
+    int             count;
+    int             dx;
+    int             dy;
+    struct timespec time;
+};
+
 /* Initialize the input device. */
 extern int init_input ();
 
+/* 
+ * Get the file descriptors on which input arrives (at most max of them),
+ * for use with select/poll/epoll; returns the number of descriptors.
+ */
+extern int get_input_fds (int fds[], int max);
+
+/* 
+ * Read all available input into the input event queue.  tick is non-zero
+ * if a simulation tick has passed since the last call; held Tux buttons
+ * repeat only then.
+ */
+extern void poll_input (int tick);
+
+/* Take the next (merged) event from the input queue; 0 if none. */
+extern int get_input_event (input_event_t* ev);
+
 /* Read a command from the input device. */
 extern cmd_t get_command ();
 
@@ -70,4 +104,7 @@ extern void shutdown_input ();
  */
 extern void display_time_on_tux (int num_seconds);
 
+/* Print the Tux controller driver's counters (if compiled for the Tux). */
+extern void report_tux_stats ();
+
 #endif /* INPUT_H */
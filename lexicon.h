@@ -0,0 +1,70 @@
+/*									tab:8
+ *
+ * lexicon.h - hashing of typed words for command and object lookup
+ *
+ * Filename:	    lexicon.h
+ */
+
+#ifndef LEXICON_H
+#define LEXICON_H
+
+#include <stdint.h>
+
+
+/*
+ * NOTES
+ *
+ * The words that a player may type--command verbs (with all of their
+ * accepted abbreviations) and object names--are known when the game is
+ * compiled.  The mklexicon program reads them from cmd_list.def and
+ * obj_data.def and generates verb_hash.h and name_hash.h, each holding a
+ * perfect hash table: a table size and seed for which lex_hash maps
+ * every word to a different slot.  Looking up a typed word thus takes
+ * one hash and one comparison with the word stored in its slot, no
+ * matter how many words there are.  Case is folded when hashing, and
+ * words are stored in lower case.
+ */
+
+/* length of the longest word that can be hashed */
+#define LEX_MAX_WORD 32
+
+/* a slot in the verb table: a verb or abbreviation and its command */
+typedef struct verb_slot_t verb_slot_t;
+struct verb_slot_t {
+    const char* word;   /* verb or abbreviation, or NULL if slot is empty */
+    int32_t     len;    /* length of word                                 */
+    int32_t     idx;    /* index of matching entry in cmd_list            */
+};
+
+/* a slot in the object name table */
+typedef struct name_slot_t name_slot_t;
+struct name_slot_t {
+    const char* word;   /* object name, or NULL if slot is empty */
+    int32_t     len;    /* length of word                        */
+    int32_t     name;   /* name identifier (OBJ_NAME_*)          */
+};
+
+/*
+ * lex_hash
+ *   DESCRIPTION: Hash a word, ignoring case (FNV-1a with a seed).
+ *   INPUTS: s -- the word
+ *           len -- length of the word
+ *           seed -- seed chosen for the table
+ *   OUTPUTS: none
+ *   RETURN VALUE: the hash value
+ *   SIDE EFFECTS: none
+ */
+static inline uint32_t
+lex_hash (const char* s, int32_t len, uint32_t seed)
+{
+    uint32_t h = 2166136261U ^ seed; /* hash value */
+    int32_t i;                       /* index into word */
+
+    for (i = 0; len > i; i++) {
+	h ^= (uint8_t)(('A' <= s[i] && 'Z' >= s[i]) ? s[i] - 'A' + 'a' : s[i]);
+	h *= 16777619U;
+    }
+    return h;
+}
+
+#endif /* LEXICON_H */
@@ -0,0 +1,295 @@
+/*									tab:8
+ *
+ * mklexicon.c - generate the typed-word hash tables (see lexicon.h)
+ *
+ * Filename:	    mklexicon.c
+ *
+ * Usage: mklexicon verbs > verb_hash.h
+ *        mklexicon names > name_hash.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "lexicon.h"
+
+
+#define MAX_WORDS   512     /* most words in one table       */
+#define MAX_SEEDS   1000000 /* seeds tried for each size     */
+
+/* the verbs, in the order of cmd_list */
+typedef struct verb_t verb_t;
+struct verb_t {
+    const char* verb;	/* verb as listed                 */
+    int min_len;	/* shortest accepted abbreviation */
+};
+
+/* the objects, in the order of obj_data */
+typedef struct obj_t obj_t;
+struct obj_t {
+    const char* id;	/* object identifier (as text) */
+    const char* name;	/* object name                 */
+};
+
+/* a word to be placed in a table */
+typedef struct word_t word_t;
+struct word_t {
+    char text[LEX_MAX_WORD + 1];  /* lower case word         */
+    int  len;                     /* length of word          */
+    int  value;                   /* value stored with word  */
+};
+
+static const verb_t verbs[] = {
+#define TYPED_CMD(verb, min_len, cmd) {verb, min_len},
+#include "cmd_list.def"
+#undef TYPED_CMD
+};
+#define N_VERBS ((int)(sizeof (verbs) / sizeof (verbs[0])))
+
+static const obj_t objs[] = {
+#define OBJ_DATA(id, name, filename, room, x, y) {#id, name},
+#include "obj_data.def"
+#undef OBJ_DATA
+};
+#define N_OBJS ((int)(sizeof (objs) / sizeof (objs[0])))
+
+
+/* local functions--see function headers for details */
+
+static int add_word (word_t words[], int n, const char* s, int len,
+		     int value);
+static int find_seed (const word_t words[], int n, int* size,
+		      uint32_t* seed);
+static void emit_verbs (void);
+static void emit_names (void);
+
+
+/*
+ * add_word
+ *   DESCRIPTION: Add a word to a list unless the list already has it.
+ *   INPUTS: words -- the list
+ *           n -- number of words in the list
+ *           s -- the word (need not be NUL-terminated)
+ *           len -- length of the word
+ *           value -- value to store with the word
+ *   OUTPUTS: words -- the list, with the word in lower case at the end
+ *   RETURN VALUE: the new number of words
+ *   SIDE EFFECTS: exits on overflow
+ */
+static int
+add_word (word_t words[], int n, const char* s, int len, int value)
+{
+    word_t w;  /* the new word                 */
+    int i;     /* loop index over word / list  */
+
+    if (LEX_MAX_WORD < len || MAX_WORDS <= n) {
+	fprintf (stderr, "mklexicon: too many words or word too long\n");
+	exit (3);
+    }
+    for (i = 0; len > i; i++) {
+	w.text[i] = ('A' <= s[i] && 'Z' >= s[i] ? s[i] - 'A' + 'a' : s[i]);
+    }
+    w.text[len] = '\0';
+    w.len = len;
+    w.value = value;
+    for (i = 0; n > i; i++) {
+	if (0 == strcmp (words[i].text, w.text)) {
+	    return n;
+	}
+    }
+    words[n] = w;
+    return n + 1;
+}
+
+
+/*
+ * find_seed
+ *   DESCRIPTION: Find the smallest power-of-two table size (at least
+ *                twice the number of words) and a seed for which lex_hash
+ *                puts every word into a different slot.
+ *   INPUTS: words -- the words
+ *           n -- number of words
+ *   OUTPUTS: size -- the table size
+ *            seed -- the seed
+ *   RETURN VALUE: 0 on success, -1 if no seed was found
+ *   SIDE EFFECTS: none
+ */
+static int
+find_seed (const word_t words[], int n, int* size, uint32_t* seed)
+{
+    static unsigned char used[MAX_WORDS * 8]; /* slots taken */
+    uint32_t s;  /* seed being tried        */
+    int sz;      /* table size being tried  */
+    int i;       /* loop index over words   */
+    uint32_t h;  /* slot for a word         */
+
+    for (sz = 2; 2 * n > sz; sz *= 2);
+    for (; MAX_WORDS * 8 >= sz; sz *= 2) {
+	for (s = 0; MAX_SEEDS > s; s++) {
+	    memset (used, 0, sz);
+	    for (i = 0; n > i; i++) {
+		h = lex_hash (words[i].text, words[i].len, s) & (sz - 1);
+		if (used[h]) {
+		    break;
+		}
+		used[h] = 1;
+	    }
+	    if (n == i) {
+		*size = sz;
+		*seed = s;
+		return 0;
+	    }
+	}
+    }
+    return -1;
+}
+
+
+/*
+ * emit_verbs
+ *   DESCRIPTION: Write the verb table.  Every abbreviation of every verb
+ *                (down to its minimum length) is a word in the table,
+ *                mapped to the first verb in cmd_list that it matches.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes verb_hash.h to stdout; exits on failure
+ */
+static void
+emit_verbs ()
+{
+    static word_t words[MAX_WORDS];
+    const word_t* slot[MAX_WORDS * 8];
+    int n = 0, size, i, len, max_len = 0;
+    uint32_t seed;
+
+    for (i = 0; N_VERBS > i; i++) {
+	if (max_len < (int)strlen (verbs[i].verb)) {
+	    max_len = strlen (verbs[i].verb);
+	}
+	for (len = verbs[i].min_len; (int)strlen (verbs[i].verb) >= len;
+	     len++) {
+	    n = add_word (words, n, verbs[i].verb, len, i);
+	}
+    }
+    if (0 != find_seed (words, n, &size, &seed)) {
+	fprintf (stderr, "mklexicon: no perfect hash for verbs\n");
+	exit (3);
+    }
+    memset (slot, 0, sizeof (slot));
+    for (i = 0; n > i; i++) {
+	slot[lex_hash (words[i].text, words[i].len, seed) & (size - 1)] =
+		&words[i];
+    }
+
+    printf ("/* verb_hash.h - generated by mklexicon from cmd_list.def */\n\n"
+	    "#ifndef VERB_HASH_H\n#define VERB_HASH_H\n\n"
+	    "#include \"lexicon.h\"\n\n"
+	    "#define VERB_HASH_SIZE %d\n#define VERB_HASH_SEED %uU\n"
+	    "#define VERB_MAX_LEN   %d\n\n"
+	    "static const verb_slot_t verb_hash[VERB_HASH_SIZE] = {\n",
+	    size, seed, max_len);
+    for (i = 0; size > i; i++) {
+	if (NULL == slot[i]) {
+	    printf ("    {NULL, 0, -1},\n");
+	} else {
+	    printf ("    {\"%s\", %d, %d},\n", slot[i]->text, slot[i]->len,
+		    slot[i]->value);
+	}
+    }
+    printf ("};\n\n#endif /* VERB_HASH_H */\n");
+}
+
+
+/*
+ * emit_names
+ *   DESCRIPTION: Write the object name index: an identifier for each
+ *                distinct (case-folded) object name, the hash table of
+ *                names, and the objects that have each name.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes name_hash.h to stdout; exits on failure
+ */
+static void
+emit_names ()
+{
+    static word_t words[MAX_WORDS];
+    const word_t* slot[MAX_WORDS * 8];
+    int n = 0, size, i, j, k, first;
+    uint32_t seed;
+
+    for (i = 0; N_OBJS > i; i++) {
+	n = add_word (words, n, objs[i].name, strlen (objs[i].name), n);
+    }
+    if (0 != find_seed (words, n, &size, &seed)) {
+	fprintf (stderr, "mklexicon: no perfect hash for object names\n");
+	exit (3);
+    }
+    memset (slot, 0, sizeof (slot));
+    for (i = 0; n > i; i++) {
+	slot[lex_hash (words[i].text, words[i].len, seed) & (size - 1)] =
+		&words[i];
+    }
+
+    printf ("/* name_hash.h - generated by mklexicon from obj_data.def */\n\n"
+	    "#ifndef NAME_HASH_H\n#define NAME_HASH_H\n\n"
+	    "#include \"lexicon.h\"\n\n"
+	    "#define NAME_HASH_SIZE %d\n#define NAME_HASH_SEED %uU\n\n"
+	    "/* object name identifiers */\nenum {\n", size, seed);
+    for (i = 0; n > i; i++) {
+	printf ("    OBJ_NAME_");
+	for (k = 0; words[i].len > k; k++) {
+	    putchar ('a' <= words[i].text[k] && 'z' >= words[i].text[k] ?
+		     words[i].text[k] - 'a' + 'A' : words[i].text[k]);
+	}
+	printf (",\n");
+    }
+    printf ("    N_OBJ_NAMES\n};\n\n"
+	    "static const name_slot_t name_hash[NAME_HASH_SIZE] = {\n");
+    for (i = 0; size > i; i++) {
+	if (NULL == slot[i]) {
+	    printf ("    {NULL, 0, -1},\n");
+	} else {
+	    printf ("    {\"%s\", %d, %d},\n", slot[i]->text, slot[i]->len,
+		    slot[i]->value);
+	}
+    }
+
+    /* objects with name k are name_objs[name_first[k]] up to next name */
+    printf ("};\n\nstatic const int32_t name_objs[%d] = {\n", N_OBJS);
+    for (i = 0; n > i; i++) {
+	for (j = 0; N_OBJS > j; j++) {
+	    if (0 == strcasecmp (words[i].text, objs[j].name)) {
+		printf ("    %s,\n", objs[j].id);
+	    }
+	}
+    }
+    printf ("};\n\nstatic const int32_t name_first[N_OBJ_NAMES + 1] = {\n");
+    for (i = 0, first = 0; n > i; i++) {
+	printf ("    %d,\n", first);
+	for (j = 0; N_OBJS > j; j++) {
+	    if (0 == strcasecmp (words[i].text, objs[j].name)) {
+		first++;
+	    }
+	}
+    }
+    printf ("    %d\n};\n\n#endif /* NAME_HASH_H */\n", first);
+}
+
+
+int
+main (int argc, char* argv[])
+{
+    if (2 == argc && 0 == strcmp (argv[1], "verbs")) {
+	emit_verbs ();
+    } else if (2 == argc && 0 == strcmp (argv[1], "names")) {
+	emit_names ();
+    } else {
+	fprintf (stderr, "syntax: %s verbs|names\n", argv[0]);
+	return 2;
+    }
+    return 0;
+}
@@ -42,13 +42,18 @@
 
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/io.h>
 #include <sys/mman.h>
+#include <sys/time.h>
 #include <unistd.h>
 
 #include "modex.h"
 #include "text.h"
+#if defined(VGA_HEADLESS)
+#include "vga_emu.h"
+#endif
 
 
 /* 
@@ -82,6 +87,19 @@
 #define NUM_GRAPHICS_REGS       9
 #define NUM_ATTR_REGS          22
 
+/* 
+ * Vertical retrace parameters.  Bit 3 of input status register 1 is set
+ * while the VGA is in vertical retrace.  The simulated retrace source models
+ * mode X's 70 Hz refresh with a two-line (about 64 microsecond) retrace
+ * pulse.  RETRACE_CALIBRATE is the number of hardware retraces timed to 
+ * measure the refresh period when VSYNC_HW is selected.
+ */
+#define INPUT_STATUS_1     0x03DA
+#define VERT_RETRACE_BIT     0x08
+#define SIM_REFRESH_USEC    14268
+#define SIM_RETRACE_USEC       64
+#define RETRACE_CALIBRATE       8
+
 /* VGA register settings for mode X */
 static unsigned short mode_X_seq[NUM_SEQUENCER_REGS] = {
     0x0100, 0x2101, 0x0F02, 0x0003, 0x0604
@@ -128,6 +146,33 @@ static unsigned short text_graphics[NUM_GRAPHICS_REGS] = {
     0xFF08
 };
 
+/*
+ * The status bar is kept as a persistent planar image, status_img, with
+ * plane p at offset p * STATUS_SIZE.  Each of the SCROLL_X_WIDTH address
+ * columns shows at most two glyph halves, each recorded as the character
+ * times two plus 0 (left four pixels) or 1 (right four pixels), or -1 for
+ * none.  The contents of status_cols match video memory only while
+ * status_valid is set; clearing the screens clears it.  Rendered room
+ * names are cached in room_names, replaced in round-robin order.
+ */
+#define ROOM_NAME_CACHE 16
+typedef struct status_col_t status_col_t;
+struct status_col_t {
+    short glyph[2];
+};
+typedef struct room_name_img_t room_name_img_t;
+struct room_name_img_t {
+    const char*    name;    /* room name, or NULL if slot unused   */
+    int            n_cols;  /* width of image in address columns   */
+    unsigned char* img;	    /* image (see room_name_image)         */
+};
+static unsigned char   status_img[STATUS_SIZE * PLANES];
+static status_col_t    status_cols[SCROLL_X_WIDTH];
+static int             status_valid = 0;
+static room_name_img_t room_names[ROOM_NAME_CACHE];
+static int             next_room_name;
+
+
 /* local functions--see function headers for details */
 static int open_memory_and_ports ();
 static void VGA_blank (int blank_bit);
@@ -141,7 +186,19 @@ static void fill_palette_text ();
 static void write_font_data ();
 static void set_text_mode_3 (int clear_scr);
 static void copy_image (unsigned char* img, unsigned short scr_addr);
-static void copy_status (unsigned char* img, unsigned short scr_addr);
+static void copy_status (unsigned char* img, unsigned short scr_addr, int n);
+static long long now_usec ();
+static int in_retrace ();
+static long long wait_for_retrace ();
+static void flush_palette ();
+static void set_status_col (status_col_t* col, int glyph);
+static void place_status_text (status_col_t cols[SCROLL_X_WIDTH], 
+			       const char* str, int alignment);
+static void render_glyph_half (unsigned char* dst, int glyph, int pitch, 
+			       int plane_size, int opaque);
+static room_name_img_t* room_name_image (const char* room);
+static void render_status_col (int c, const status_col_t* col, 
+			       const room_name_img_t* rn);
 
 /* 
  * Images are built in this buffer, then copied to the video memory.
@@ -184,6 +241,23 @@ static int show_x, show_y;          /* logical view coordinates     */
 static unsigned char* mem_image;    /* pointer to start of video memory */
 static unsigned short target_img;   /* offset of displayed screen image */
 
+/* 
+ * Presentation synchronization state.  last_retrace records the time (in
+ * microseconds) of the most recent retrace observed by show_screen, and
+ * retrace_period the interval between retraces; together they project the
+ * deadline for the next frame.  Palette writes made while vsync is enabled
+ * are accumulated in pending_palette; pal_dirty marks the colors waiting
+ * to be written, all of which lie in pal_lo through pal_hi (inclusive).
+ */
+static vsync_mode_t vsync_mode = VSYNC_OFF;
+static long long sim_epoch;         /* time origin of simulated retrace */
+static long long last_retrace;      /* time of last observed retrace    */
+static long long retrace_period;    /* microseconds between retraces    */
+static present_stats_t present_stats;
+static unsigned char pending_palette[256][3];
+static unsigned char pal_dirty[256];
+static int pal_lo = 256, pal_hi = -1;
+
 
 /* 
  * functions provided by the caller to set_mode_X() and used to obtain  
@@ -192,8 +266,16 @@ static unsigned short target_img;   /* offset of displayed screen image */
  */
 static void (*horiz_line_fn) (int, int, unsigned char[SCROLL_X_DIM]);
 static void (*vert_line_fn) (int, int, unsigned char[SCROLL_Y_DIM]);
+
+/* planar canvas (see modex.h) used instead of the fill functions if set */
+static const unsigned char* canvas;
+static int canvas_width;	    /* width of canvas in addresses     */
+static int canvas_height;	    /* height of canvas in pixels       */
+static int canvas_plane;	    /* size of one canvas plane         */
 	
 
+#if !defined(VGA_HEADLESS)
+
 /* 
  * macro used to target a specific video plane or planes when writing
  * to video memory in mode X; bits 8-11 in the mask_hi_bits enable writes
@@ -218,6 +300,16 @@ do {                                                                    \
       : "memory", "cc");                                                \
 } while (0)
 
+/* macro used to read a byte from a port */
+#define INB(port,val)                                                   \
+do {                                                                    \
+    asm volatile ("                                                     \
+        inb (%w1),%b0                                                   \
+    " : "=a" ((val))                                                    \
+      : "d" ((port))                                                    \
+      : "memory");                                                      \
+} while (0)
+
 /* macro used to write two bytes to two consecutive ports */
 #define OUTW(port,val)                                                  \
 do {                                                                    \
@@ -260,6 +352,45 @@ do {                                                                    \
       : "eax", "memory", "cc");                                         \
 } while (0)
 
+#else /* defined(VGA_HEADLESS) */
+
+/*
+ * In the headless build, the same macros drive the software VGA in 
+ * vga_emu.c instead of the hardware, so no port permissions are needed.
+ */
+#define SET_WRITE_MASK(mask_hi_bits)                                    \
+do {                                                                    \
+    vga_emu_outw (0x03C4, ((mask_hi_bits) & 0xFF00) | 0x02);           \
+} while (0)
+#define OUTB(port,val)                                                  \
+do {                                                                    \
+    vga_emu_outb ((port), (val));                                      \
+} while (0)
+#define INB(port,val)                                                   \
+do {                                                                    \
+    (val) = vga_emu_inb ((port));                                      \
+} while (0)
+#define OUTW(port,val)                                                  \
+do {                                                                    \
+    vga_emu_outw ((port), (val));                                      \
+} while (0)
+#define REP_OUTSW(port,source,count)                                    \
+do {                                                                    \
+    const unsigned short* _src = (const unsigned short*)(source);       \
+    int _n;                                                             \
+    for (_n = (count); _n > 0; _n--)                                    \
+        vga_emu_outw ((port), *_src++);                                 \
+} while (0)
+#define REP_OUTSB(port,source,count)                                    \
+do {                                                                    \
+    const unsigned char* _src = (const unsigned char*)(source);         \
+    int _n;                                                             \
+    for (_n = (count); _n > 0; _n--)                                    \
+        vga_emu_outb ((port), *_src++);                                 \
+} while (0)
+
+#endif /* !defined(VGA_HEADLESS) */
+
 
 /*
  * set_mode_X
@@ -329,6 +460,7 @@ set_mode_X (void (*horiz_fill_fn) (int, int, unsigned char[SCROLL_X_DIM]),
     set_graphics_registers (mode_X_graphics);    /* graphics registers    */
     fill_palette_mode_x ();			 /* palette colors        */
     clear_screens ();				 /* zero video memory     */
+    init_glyph_atlas ();			 /* build status font     */
     VGA_blank (0);			         /* unblank the screen    */
 
     /* Return success. */
@@ -350,6 +482,16 @@ clear_mode_X ()
 {
     int i;   /* loop index for checking memory fence */
     
+    /* Discard palette changes deferred for a mode X frame. */
+    (void)memset (pal_dirty, 0, sizeof (pal_dirty));
+    pal_lo = 256;
+    pal_hi = -1;
+
+#if defined(VGA_HEADLESS)
+    /* Dump the final mode X frame before the registers change. */
+    vga_emu_close ();
+#endif
+
     /* Put VGA into text mode, restore font data, and clear screens. */
     set_text_mode_3 (1);
 
@@ -501,6 +643,22 @@ show_screen ()
     unsigned char* addr;  /* source address for copy             */
     int p_off;            /* plane offset of first display plane */
     int i;		  /* loop index over video planes        */
+    long long start;      /* time at which presentation began    */
+    long long deadline;   /* retrace by which frame should show  */
+    long long flip;       /* retrace at which frame was shown    */
+    long long late;       /* lateness of frame in microseconds   */
+    unsigned long missed; /* number of retraces missed by frame  */
+
+    /* 
+     * The frame's deadline is the first retrace after we start; project
+     * it from the last retrace seen (or from the simulated time origin).
+     */
+    deadline = 0;
+    if (VSYNC_OFF != vsync_mode) {
+	start = now_usec ();
+	deadline = last_retrace + retrace_period * 
+		   ((start - last_retrace) / retrace_period + 1);
+    }
 
     /* 
      * Calculate offset of build buffer plane to be mapped into plane 0 
@@ -524,12 +682,202 @@ show_screen ()
 	            target_img);
     }
 
+    /* 
+     * The CRTC latches the start address at the beginning of vertical 
+     * retrace.  When synchronizing, let any retrace in progress finish
+     * so that the address is never changed while being latched.
+     */
+    if (VSYNC_OFF != vsync_mode) {
+	while (in_retrace ());
+    }
+
+#if defined(VGA_HEADLESS)
+    /* Let the software VGA record the frame being replaced. */
+    vga_emu_present ();
+#endif
+
     /* 
      * Change the VGA registers to point the top left of the screen
      * to the video memory that we just filled.
      */
     OUTW (0x03D4, (target_img & 0xFF00) | 0x0C);
     OUTW (0x03D4, ((target_img & 0x00FF) << 8) | 0x0D);
+
+    if (VSYNC_OFF == vsync_mode) {
+        return;
+    }
+
+    /* 
+     * Wait for the retrace that displays the new frame, then use the
+     * blanking interval to upload any palette changes made for it.
+     */
+    flip = wait_for_retrace ();
+    flush_palette ();
+
+    /* Account for the frame. */
+    late = flip - deadline;
+    if (0 > late) {
+        late = 0;
+    }
+    missed = (late + retrace_period / 2) / retrace_period;
+    present_stats.frames++;
+    if (0 < missed) {
+	present_stats.late_frames++;
+	present_stats.missed_retraces += missed;
+    }
+    present_stats.total_late_usec += late;
+    if (present_stats.max_late_usec < late) {
+        present_stats.max_late_usec = late;
+    }
+}
+
+
+/*
+ * set_vsync_mode
+ *   DESCRIPTION: Select whether and how show_screen synchronizes with the
+ *                vertical retrace.  For VSYNC_HW, the refresh period is
+ *                measured by timing several retraces, so mode X must 
+ *                already be set.  Any palette changes still pending when
+ *                synchronization is turned off are written immediately.
+ *   INPUTS: mode -- VSYNC_OFF, VSYNC_HW, or VSYNC_SIM
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on an invalid mode
+ *   SIDE EFFECTS: resets presentation statistics
+ */
+int
+set_vsync_mode (vsync_mode_t mode)
+{
+    long long first; /* time of first retrace timed for calibration */
+    int i;           /* loop index over calibration retraces        */
+
+    if (VSYNC_OFF != mode && VSYNC_HW != mode && VSYNC_SIM != mode)
+        return -1;
+
+    /* Write any deferred palette changes before changing modes. */
+    if (VSYNC_OFF != vsync_mode) {
+	vsync_mode = VSYNC_OFF;
+	flush_palette ();
+    }
+
+    (void)memset (&present_stats, 0, sizeof (present_stats));
+    vsync_mode = mode;
+    if (VSYNC_SIM == mode) {
+	retrace_period = SIM_REFRESH_USEC;
+        sim_epoch = last_retrace = now_usec ();
+    } else if (VSYNC_HW == mode) {
+	/* Time a few retraces to measure the refresh period. */
+	while (in_retrace ());
+	first = wait_for_retrace ();
+	for (i = 0; i < RETRACE_CALIBRATE; i++) {
+	    while (in_retrace ());
+	    last_retrace = wait_for_retrace ();
+	}
+	retrace_period = (last_retrace - first) / RETRACE_CALIBRATE;
+	if (0 >= retrace_period) {
+	    retrace_period = SIM_REFRESH_USEC;
+	}
+    }
+    present_stats.retrace_usec = retrace_period;
+
+    /* Return success. */
+    return 0;
+}
+
+
+/*
+ * get_present_stats
+ *   DESCRIPTION: Copy the frame presentation statistics gathered since 
+ *                vsync was last enabled.
+ *   INPUTS: none
+ *   OUTPUTS: stats -- the statistics
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+get_present_stats (present_stats_t* stats)
+{
+    *stats = present_stats;
+}
+
+
+/*
+ * prefault_pages
+ *   DESCRIPTION: Touch every page of a memory area so that the pages are
+ *                mapped (and, after mlockall, stay mapped) before they are
+ *                needed.  Each page is read and written back, so pages 
+ *                that have never been written get private copies, too.
+ *   INPUTS: addr -- start of the area
+ *           len -- length of the area in bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may page-fault once per page
+ */
+void
+prefault_pages (void* addr, unsigned long len)
+{
+    volatile unsigned char* p = addr; /* the area           */
+    unsigned long page;               /* page size in bytes */
+    unsigned long i;                  /* offset into area   */
+
+    if (0 == len) {
+	return;
+    }
+    page = sysconf (_SC_PAGESIZE);
+    for (i = 0; len > i; i += page) {
+	p[i] = p[i];
+    }
+    p[len - 1] = p[len - 1];
+}
+
+
+/*
+ * prefault_build_buffer
+ *   DESCRIPTION: Prefault the build buffer (including its fences).
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may page-fault
+ */
+void
+prefault_build_buffer ()
+{
+    prefault_pages (build, sizeof (build));
+}
+
+
+/*
+ * set_palette
+ *   DESCRIPTION: Set a range of VGA palette colors.  When vsync is off, the
+ *                colors are written to the DAC immediately.  Otherwise, 
+ *                they are recorded and written by show_screen during the
+ *                blanking interval before the next frame is displayed.
+ *   INPUTS: first -- the first color to set
+ *           count -- number of colors to set
+ *           rgb -- 6-bit RGB values for the colors
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes (or schedules changes to) the palette
+ */
+void
+set_palette (int first, int count, unsigned char rgb[][3])
+{
+    if (0 > first || 0 >= count || 256 < first + count)
+        return;
+
+    if (VSYNC_OFF == vsync_mode) {
+	OUTB (0x03C8, first);
+	REP_OUTSB (0x03C9, rgb, count * 3);
+	return;
+    }
+
+    (void)memcpy (pending_palette[first], rgb, count * 3);
+    (void)memset (pal_dirty + first, 1, count);
+    if (pal_lo > first) {
+        pal_lo = first;
+    }
+    if (pal_hi < first + count - 1) {
+        pal_hi = first + count - 1;
+    }
 }
 
 
@@ -547,8 +895,15 @@ clear_screens ()
     /* Write to all four planes at once. */ 
     SET_WRITE_MASK (0x0F00);
 
+    /* The status bar must be copied in full next time. */
+    status_valid = 0;
+
     /* Set 64kB to zero (times four planes = 256kB). */
+#if defined(VGA_HEADLESS)
+    vga_emu_fill (0, 0, MODE_X_MEM_SIZE);
+#else
     memset (mem_image, 0, MODE_X_MEM_SIZE);
+#endif
 }
 
 
@@ -591,15 +946,27 @@ draw_vert_line (int x)
 	/* Adjust x to the logical row value. */
 	x = x + show_x;
 	
-	/* Get the image of the line. */
-	(*vert_line_fn) (x,show_y , buf);
-	
 	/* Calculate starting address in build buffer */
 	addr = img3 + (x >> 2) + show_y * SCROLL_X_WIDTH;
 	
 	/* Calculate plane offset of first pixel. */
 	p_off = (3 - (x & 3));
 	
+	/* Copy the line from the canvas if it lies within the canvas. */
+	if (NULL != canvas && 0 <= x && canvas_width > (x >> 2) &&
+	    0 <= show_y && canvas_height >= show_y + SCROLL_Y_DIM) {
+		const unsigned char* src = canvas + (x & 3) * canvas_plane +
+				           show_y * canvas_width + (x >> 2);
+		for (i = 0; i < SCROLL_Y_DIM; i++) {
+			addr[p_off * SCROLL_SIZE + i * SCROLL_X_WIDTH] = 
+			    src[i * canvas_width];
+		}
+		return 0;
+	}
+	
+	/* Get the image of the line. */
+	(*vert_line_fn) (x,show_y , buf);
+	
 	/* Copy image data into appropriate planes into build buffer. */
 	for (i = 0; i < SCROLL_Y_DIM; i++) {
 		addr[p_off * SCROLL_SIZE + i * SCROLL_X_WIDTH] = buf[i];
@@ -637,6 +1004,22 @@ draw_horiz_line (int y)
 
     /* Adjust y to the logical row value. */
     y += show_y;
+
+    /* 
+     * Copy the line from the canvas if it lies within the canvas: the 80
+     * pixels of each plane are contiguous in both canvas and build buffer.
+     */
+    if (NULL != canvas && 0 <= y && canvas_height > y && 0 <= show_x &&
+        canvas_width * 4 >= show_x + SCROLL_X_DIM) {
+	for (i = 0; i < 4; i++) {
+	    /* x is the first pixel of the line in plane i */
+	    int x = show_x + ((i - show_x) & 3);
+	    (void)memcpy (img3 + (3 - i) * SCROLL_SIZE + (x >> 2) + 
+	    		  y * SCROLL_X_WIDTH, canvas + i * canvas_plane + 
+			  y * canvas_width + (x >> 2), SCROLL_X_WIDTH);
+	}
+	return 0;
+    }
 	
     /* Get the image of the line. */
     (*horiz_line_fn) (show_x, y, buf);
@@ -662,6 +1045,79 @@ draw_horiz_line (int y)
 
 
 
+/*
+ * set_canvas
+ *   DESCRIPTION: Select a planar canvas (see modex.h) from which lines are
+ *                copied into the build buffer instead of being obtained
+ *                from the fill functions passed to set_mode_X.  The caller
+ *                must keep the canvas allocated while it is set.
+ *   INPUTS: canvas -- the canvas, or NULL to use the fill functions
+ *           width -- width of the canvas in addresses
+ *           height -- height of the canvas in pixels
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the source of lines drawn into the build buffer
+ */
+void
+set_canvas (const unsigned char* new_canvas, int width, int height)
+{
+    if (NULL == new_canvas || 0 >= width || 0 >= height) {
+	canvas = NULL;
+	return;
+    }
+    canvas = new_canvas;
+    canvas_width = width;
+    canvas_height = height;
+    canvas_plane = width * height;
+}
+
+
+/*
+ * save_view
+ *   DESCRIPTION: Copy the planar image of the logical view window from the
+ *                build buffer.  When the window's x position is a multiple
+ *                of four, each plane of the window occupies SCROLL_SIZE
+ *                contiguous bytes, and the four planes are adjacent, so
+ *                a single copy suffices.
+ *   INPUTS: none
+ *   OUTPUTS: buf -- the four planes of the window (3, 2, 1, then 0)
+ *   RETURN VALUE: 0 on success, or -1 if the window x position is not a
+ *                 multiple of four
+ *   SIDE EFFECTS: none
+ */
+int
+save_view (unsigned char buf[VIEW_SAVE_SIZE])
+{
+    if (0 != (show_x & 3))
+	return -1;
+    (void)memcpy (buf, img3 + (show_x >> 2) + show_y * SCROLL_X_WIDTH,
+		  VIEW_SAVE_SIZE);
+    return 0;
+}
+
+
+/*
+ * restore_view
+ *   DESCRIPTION: Replace the logical view window in the build buffer with
+ *                an image previously obtained from save_view (at the
+ *                same view window alignment).
+ *   INPUTS: buf -- the four planes of the window (3, 2, 1, then 0)
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, or -1 if the window x position is not a
+ *                 multiple of four
+ *   SIDE EFFECTS: draws into the build buffer
+ */
+int
+restore_view (const unsigned char buf[VIEW_SAVE_SIZE])
+{
+    if (0 != (show_x & 3))
+	return -1;
+    (void)memcpy (img3 + (show_x >> 2) + show_y * SCROLL_X_WIDTH, buf,
+		  VIEW_SAVE_SIZE);
+    return 0;
+}
+
+
 #endif /* !defined(TEXT_RESTORE_PROGRAM) */
 
 
@@ -677,6 +1133,20 @@ draw_horiz_line (int y)
 static int
 open_memory_and_ports ()
 {
+#if defined(VGA_HEADLESS)
+    /* 
+     * Video memory writes go to the software VGA; mem_image only backs the
+     * text mode font and screen writes, which are not displayed.
+     */
+    if (vga_emu_init () == -1)
+        return -1;
+    if ((mem_image = mmap (0, VID_MEM_SIZE, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+	perror ("mmap video memory");
+	return -1;
+    }
+    return 0;
+#else
     int mem_fd;  /* file descriptor for physical memory image */
 
     /* Obtain permission to access ports 0x03C0 through 0x03DA. */
@@ -701,6 +1171,7 @@ open_memory_and_ports ()
     /* Close /dev/mem file descriptor and return success. */
     (void)close (mem_fd);
     return 0;
+#endif
 }
 
 
@@ -721,6 +1192,17 @@ VGA_blank (int blank_bit)
      */
     blank_bit = ((blank_bit & 1) << 5);
 
+#if defined(VGA_HEADLESS)
+    {
+	unsigned char val; /* sequencer register 1 / status register */
+
+	OUTB (0x03C4, 0x01);
+	INB (0x03C5, val);
+	OUTB (0x03C5, (val & 0xDF) | blank_bit);
+	INB (0x03DA, val);
+	OUTB (0x03C0, 0x20);
+    }
+#else
     asm volatile (
 	"movb $0x01,%%al         /* Set sequencer index to 1. */       ;"
 	"movw $0x03C4,%%dx                                             ;"
@@ -736,6 +1218,7 @@ VGA_blank (int blank_bit)
 	"movb $0x20,%%al                                               ;"
 	"outb %%al,(%%dx)                                               "
       : : "g" (blank_bit) : "eax", "edx", "memory");
+#endif
 }
 
 
@@ -803,9 +1286,13 @@ static void
 set_attr_registers (unsigned char table[NUM_ATTR_REGS * 2])
 {
     /* Reset attribute register to write index next rather than data. */
+#if defined(VGA_HEADLESS)
+    (void)vga_emu_inb (0x03DA);
+#else
     asm volatile (
 	"inb (%%dx),%%al"
       : : "d" (0x03DA) : "eax", "memory");
+#endif
     REP_OUTSB (0x03C0, table, NUM_ATTR_REGS * 2);
 }
 
@@ -973,7 +1460,7 @@ write_font_data ()
 static void
 set_text_mode_3 (int clear_scr)
 {
-    unsigned long* txt_scr; /* pointer to text screens in video memory */
+    unsigned int* txt_scr;  /* pointer to text screens in video memory */
     int i;                  /* loop over text screen words             */
 
     VGA_blank (1);                               /* blank the screen        */
@@ -988,7 +1475,7 @@ set_text_mode_3 (int clear_scr)
     set_graphics_registers (text_graphics);      /* graphics registers      */
     fill_palette_text ();			 /* palette colors          */
     if (clear_scr) {				 /* clear screens if needed */
-	txt_scr = (unsigned long*)(mem_image + 0x18000); 
+	txt_scr = (unsigned int*)(mem_image + 0x18000); 
 	for (i = 0; i < 8192; i++)
 	    *txt_scr++ = 0x07200720;
     }
@@ -1015,6 +1502,9 @@ copy_image (unsigned char* img, unsigned short scr_addr)
      * implemented using ISA-specific features like those below,
      * but the code here provides an example of x86 string moves
      */
+#if defined(VGA_HEADLESS)
+    vga_emu_write (scr_addr, img, 16000);
+#else
     asm volatile (
         "cld                                                 ;"
        	"movl $16000,%%ecx                                   ;"
@@ -1023,12 +1513,204 @@ copy_image (unsigned char* img, unsigned short scr_addr)
       : "S" (img), "D" (mem_image + scr_addr) 
       : "eax", "ecx", "memory"
     );
+#endif
 }
 
+/*
+ * set_status_col
+ *   DESCRIPTION: Record a glyph half in a status bar column description,
+ *                as the first or (if the column is already in use by
+ *                overlapping text) second glyph half in that column.
+ *   INPUTS: col -- the column description
+ *           glyph -- character times two plus half (0 left, 1 right)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+set_status_col (status_col_t* col, int glyph)
+{
+    if (0 > col->glyph[0]) {
+	col->glyph[0] = glyph;
+    } else {
+	col->glyph[1] = glyph;
+    }
+}
+
+
+/*
+ * place_status_text
+ *   DESCRIPTION: Describe the columns covered by a string in the status
+ *                bar.  Each character covers two address columns.
+ *   INPUTS: str -- the string
+ *           alignment -- 0 for left, 1 for center, 2 for right
+ *   OUTPUTS: cols -- descriptions of the status bar columns
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+place_status_text (status_col_t cols[SCROLL_X_WIDTH], const char* str, 
+		   int alignment)
+{
+    int len = strlen (str);  /* length of string                 */
+    int start_x;             /* first column of string           */
+    int i;                   /* loop index over characters       */
+    int c;                   /* column of left half of character */
+
+    start_x = (0 == alignment ? 0 : 
+    	       (1 == alignment ? 40 - len : 2 * (40 - len)));
+    for (i = 0; len > i; i++) {
+	c = start_x + 2 * i;
+	if (0 <= c && SCROLL_X_WIDTH > c) {
+	    set_status_col (&cols[c], ((unsigned char)str[i] << 1));
+	}
+	if (0 <= c + 1 && SCROLL_X_WIDTH > c + 1) {
+	    set_status_col (&cols[c + 1], ((unsigned char)str[i] << 1) | 1);
+	}
+    }
+}
+
+
+/*
+ * render_glyph_half
+ *   DESCRIPTION: Copy half of a character (four pixels wide) from the
+ *                glyph atlas into one address column of a planar image
+ *                whose rows are pitch bytes apart and whose planes are
+ *                plane_size bytes apart.  An opaque copy writes both text
+ *                and background pixels; otherwise, only text pixels are
+ *                written (to overlay a second glyph).
+ *   INPUTS: glyph -- character times two plus half (0 left, 1 right)
+ *           pitch -- distance between rows in bytes
+ *           plane_size -- distance between planes in bytes
+ *           opaque -- 1 to copy background pixels, 0 to skip them
+ *   OUTPUTS: dst -- the top row of the column in plane 0
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void
+render_glyph_half (unsigned char* dst, int glyph, int pitch, int plane_size,
+		   int opaque)
+{
+    int j;  /* loop index over font rows */
+    int p;  /* loop index over planes    */
+
+    for (p = 0; PLANES > p; p++) {
+	for (j = 0; FONT_HEIGHT > j; j++) {
+	    if (opaque || 
+	        TEXT_COLOR == glyph_atlas[glyph >> 1][p][j][glyph & 1]) {
+		dst[p * plane_size + j * pitch] = 
+		    glyph_atlas[glyph >> 1][p][j][glyph & 1];
+	    }
+	}
+    }
+}
+
+
+/*
+ * room_name_image
+ *   DESCRIPTION: Find (or render and cache) the image of a room name as
+ *                drawn at the left of the status bar: text pixels over
+ *                the status bar color, FONT_HEIGHT rows of two columns
+ *                per character, one plane after another.  Names are 
+ *                identified by address, as room names are never freed.
+ *   INPUTS: room -- the room name
+ *   OUTPUTS: none
+ *   RETURN VALUE: the cache entry for the name, or NULL if no memory is
+ *                 available
+ *   SIDE EFFECTS: may replace the oldest cached name
+ */
+static room_name_img_t*
+room_name_image (const char* room)
+{
+    room_name_img_t* rn;  /* cache entry          */
+    int n_cols;           /* width of image       */
+    int i;                /* loop index           */
+
+    for (i = 0; ROOM_NAME_CACHE > i; i++) {
+	if (room == room_names[i].name) {
+	    return &room_names[i];
+	}
+    }
+
+    rn = &room_names[next_room_name];
+    n_cols = 2 * strlen (room);
+    if (SCROLL_X_WIDTH < n_cols) {
+	n_cols = SCROLL_X_WIDTH;
+    }
+    free (rn->img);
+    rn->name = NULL;
+    if (NULL == (rn->img = malloc (PLANES * FONT_HEIGHT * n_cols + 1))) {
+	return NULL;
+    }
+    for (i = 0; n_cols > i; i++) {
+	render_glyph_half (rn->img + i, ((unsigned char)room[i >> 1] << 1) | 
+			   (i & 1), n_cols, FONT_HEIGHT * n_cols, 1);
+    }
+    rn->name = room;
+    rn->n_cols = n_cols;
+    next_room_name = (next_room_name + 1) % ROOM_NAME_CACHE;
+    return rn;
+}
+
+
+/*
+ * render_status_col
+ *   DESCRIPTION: Redraw one address column (all four planes) of the 
+ *                status bar image.  A column showing only part of the
+ *                room name is copied from the room name's cached image;
+ *                other columns are drawn from the font.
+ *   INPUTS: c -- the column
+ *           col -- description of the column's contents
+ *           rn -- cached image of the room name shown, or NULL
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes status_img
+ */
+static void
+render_status_col (int c, const status_col_t* col, const room_name_img_t* rn)
+{
+    int p;  /* loop index over planes */
+    int j;  /* loop index over rows   */
+
+    if (NULL != rn && rn->n_cols > c && 0 > col->glyph[1] &&
+        col->glyph[0] == (((unsigned char)rn->name[c >> 1] << 1) | (c & 1))) {
+	for (p = 0; PLANES > p; p++) {
+	    status_img[p * STATUS_SIZE + c] = COLOR;
+	    for (j = 0; FONT_HEIGHT > j; j++) {
+		status_img[p * STATUS_SIZE + (j + 1) * SCROLL_X_WIDTH + c] = 
+		    rn->img[(p * FONT_HEIGHT + j) * rn->n_cols + c];
+	    }
+	    status_img[p * STATUS_SIZE + (NUM_STATUS_ROWS - 1) * 
+	    	       SCROLL_X_WIDTH + c] = COLOR;
+	}
+	return;
+    }
+
+    /* Fill the rows above and below the text, then copy the glyphs. */
+    for (p = 0; PLANES > p; p++) {
+	status_img[p * STATUS_SIZE + c] = COLOR;
+	status_img[p * STATUS_SIZE + (NUM_STATUS_ROWS - 1) * 
+		   SCROLL_X_WIDTH + c] = COLOR;
+	if (0 > col->glyph[0]) {
+	    for (j = 1; NUM_STATUS_ROWS - 1 > j; j++) {
+		status_img[p * STATUS_SIZE + j * SCROLL_X_WIDTH + c] = COLOR;
+	    }
+	}
+    }
+    for (j = 0; 2 > j && 0 <= col->glyph[j]; j++) {
+	render_glyph_half (status_img + SCROLL_X_WIDTH + c, col->glyph[j],
+			   SCROLL_X_WIDTH, STATUS_SIZE, (0 == j));
+    }
+}
+
+
 /*
  * draw_status_bar
- *   DESCRIPTION: Draws the status bar to the screen by getting the buffer from
- *                text_graphics and then calling copy_status.
+ *   DESCRIPTION: Draws the status bar to the screen.  The status bar is
+ *                kept as a persistent planar image; only the address 
+ *                columns whose characters have changed since the last
+ *                call are redrawn, and only the span of changed columns
+ *                is copied to video memory.
  *   INPUTS: room -- a pointer to the room string
  *           status -- a pointer to the status string
  *			 typed_text -- a pointer to the typed text (command line) string.
@@ -1036,63 +1718,193 @@ copy_image (unsigned char* img, unsigned short scr_addr)
  *   RETURN VALUE: none
  *   SIDE EFFECTS: Draws the status bar on the screen
  */   
+void
+draw_status_bar (const char * room, const char * status, 
+		 const char * typed_text)
+{
+    status_col_t want[SCROLL_X_WIDTH]; /* desired column contents   */
+    room_name_img_t* rn;               /* cached room name image    */
+    int lo, hi;                        /* span of changed columns   */
+    int i, j;                          /* loop indices              */
+
+    /* Describe the desired contents of each column. */
+    for (i = 0; SCROLL_X_WIDTH > i; i++) {
+	want[i].glyph[0] = want[i].glyph[1] = -1;
+    }
+    rn = NULL;
+    if (*status != '\0') {
+	place_status_text (want, status, 1);
+    } else {
+	place_status_text (want, room, 0);
+	place_status_text (want, typed_text, 2);
+	rn = room_name_image (room);
+    }
 
-
-
-
- void draw_status_bar (const char * room, const char * status, const char * typed_text)
- {
-	int i;			/* loop counter for addresses*/
-	unsigned char buf[STATUS_SIZE*4]; 	/* STATUS_SIZE*4 to account for 4 planes per address */
-	for (i = 0; i < STATUS_SIZE*4; i++)
-	{
-		buf[i] = COLOR;
+    /* Redraw the columns that changed. */
+    lo = SCROLL_X_WIDTH;
+    hi = -1;
+    for (i = 0; SCROLL_X_WIDTH > i; i++) {
+	if (status_valid && want[i].glyph[0] == status_cols[i].glyph[0] &&
+	    want[i].glyph[1] == status_cols[i].glyph[1]) {
+	    continue;
 	}
-	if (*status != '\0')
-	{
-		text_to_graphics(buf, status, 1);
+	render_status_col (i, &want[i], rn);
+	status_cols[i] = want[i];
+	if (lo > i) {
+	    lo = i;
 	}
-	else
-	{
-		text_to_graphics(buf, room, 0);
-		text_to_graphics(buf, typed_text, 2);
-	}
-	for (i = 0; i < 4; i++) 
-	{
+	hi = i;
+    }
+    status_valid = 1;
+    if (lo > hi) {
+	return;
+    }
+
+#if defined(VGA_HEADLESS)
+    /* 
+     * The status bar changes without a new display start address, so 
+     * let the software VGA record the frame being replaced here, too.
+     */
+    vga_emu_present ();
+#endif
+
+    /* Copy the changed span of each row of each plane. */
+    for (i = 0; PLANES > i; i++) {
 	SET_WRITE_MASK (1 << (i + 8));
-	copy_status(buf + i*STATUS_SIZE, 0);
+	for (j = 0; NUM_STATUS_ROWS > j; j++) {
+	    copy_status (status_img + i * STATUS_SIZE + j * SCROLL_X_WIDTH + lo,
+	    		 j * SCROLL_X_WIDTH + lo, hi - lo + 1);
 	}
- }
+    }
+}
  
 /*
  * copy_status
- *		DESCRIPTION: Copy one plane of a plane from the build buffer to the
+ *		DESCRIPTION: Copy part of one plane of the status bar image to the
  *		video memory.
- *	INPUTS: img -- a pointer to a single screen plane in the build buffer
+ *	INPUTS: img -- a pointer into a single plane of the status bar image
  *		scr_addr -- the destination offset in video memory
+ *		n -- the number of bytes to copy
  *	OUTPUTS: none
  *	RETURN VALUE: none
- *	SIDE EFFECTS: copies a plane from the status buffer to video memory
+ *	SIDE EFFECTS: copies bytes from the status bar image to video memory
  */
 
 static void
-copy_status (unsigned char* img, unsigned short scr_addr)
+copy_status (unsigned char* img, unsigned short scr_addr, int n)
 {
     /* 
      * memcpy is actually probably good enough here, and is usually
      * implemented using ISA-specific features like those below,
      * but the code here provides an example of x86 string moves
      */
+#if defined(VGA_HEADLESS)
+    vga_emu_write (scr_addr, img, n);
+#else
+    unsigned char* dst = mem_image + scr_addr;
+
     asm volatile (
         "cld                                                 ;"
-       	"movl $1440,%%ecx                                   ;"
        	"rep movsb    # copy ECX bytes from M[ESI] to M[EDI]  "
-      : /* no outputs */
-      : "S" (img), "D" (mem_image + scr_addr) 
-      : "eax", "ecx", "memory"
+      : "+S" (img), "+D" (dst), "+c" (n)
+      : /* no other inputs */
+      : "memory"
     );
+#endif
+}
+
+/*
+ * now_usec
+ *   DESCRIPTION: Read the current time in microseconds.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: current time of day in microseconds
+ *   SIDE EFFECTS: none
+ */
+static long long
+now_usec ()
+{
+    struct timeval tv; /* current time */
+
+    (void)gettimeofday (&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
 }
 
+
+/*
+ * in_retrace
+ *   DESCRIPTION: Check whether the display is in vertical retrace, either
+ *                by reading input status register 1 or, for VSYNC_SIM, by
+ *                comparing the time with the simulated refresh schedule.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 during vertical retrace, 0 otherwise
+ *   SIDE EFFECTS: none
+ */
+static int
+in_retrace ()
+{
+    unsigned char status; /* value of input status register 1 */
+
+    if (VSYNC_SIM == vsync_mode) {
+        return ((now_usec () - sim_epoch) % SIM_REFRESH_USEC < 
+		SIM_RETRACE_USEC);
+    }
+    INB (INPUT_STATUS_1, status);
+    return (0 != (status & VERT_RETRACE_BIT));
+}
+
+
+/*
+ * wait_for_retrace
+ *   DESCRIPTION: Wait for the start of the next vertical retrace.  The
+ *                caller must ensure that the display is not already in
+ *                retrace.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: time at which the retrace was observed (microseconds)
+ *   SIDE EFFECTS: records the time of the retrace
+ */
+static long long
+wait_for_retrace ()
+{
+    while (!in_retrace ());
+    last_retrace = now_usec ();
+    return last_retrace;
+}
+
+
+/*
+ * flush_palette
+ *   DESCRIPTION: Write any deferred palette colors to the DAC, one write
+ *                of the DAC index per contiguous run of changed colors.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the palette; clears the pending range
+ */
+static void
+flush_palette ()
+{
+    int i;     /* first color of a run  */
+    int end;   /* one past end of a run */
+
+    for (i = pal_lo; pal_hi >= i; i = end) {
+	if (!pal_dirty[i]) {
+	    end = i + 1;
+	    continue;
+	}
+	for (end = i; pal_hi >= end && pal_dirty[end]; end++) {
+	    pal_dirty[end] = 0;
+	}
+	OUTB (0x03C8, i);
+	REP_OUTSB (0x03C9, pending_palette[i], (end - i) * 3);
+    }
+    pal_lo = 256;
+    pal_hi = -1;
+}
+
+
 #if defined(TEXT_RESTORE_PROGRAM)
 
 /*
@@ -112,6 +112,36 @@
  * is drawn.  Other data are left untouched in most cases.
  */
 
+/*
+ * Presentation may optionally be synchronized with the vertical retrace.
+ * VSYNC_OFF flips the display start address as soon as the new image has
+ * been copied to video memory (the original behavior).  VSYNC_HW polls the
+ * vertical retrace bit of input status register 1 (port 0x3DA), changes the
+ * start address only while the display is active, and waits for the next
+ * retrace to latch it.  VSYNC_SIM does the same against a simulated 70 Hz
+ * retrace derived from the system clock, which allows the logic to be
+ * exercised without a monitor.  In either synchronized mode, palette
+ * uploads are deferred until the blanking interval that shows the frame.
+ */
+typedef enum {VSYNC_OFF, VSYNC_HW, VSYNC_SIM} vsync_mode_t;
+
+/*
+ * Frame presentation statistics.  A frame's deadline is the first vertical
+ * retrace after show_screen is called; a frame is late if its start address
+ * is latched by a later retrace, and each retrace skipped in this way is 
+ * counted as missed.  Lateness is measured in microseconds from the
+ * deadline to the retrace that actually showed the frame.
+ */
+typedef struct present_stats_t present_stats_t;
+struct present_stats_t {
+    unsigned long frames;	   /* frames presented with vsync enabled */
+    unsigned long late_frames;	   /* frames that missed their deadline   */
+    unsigned long missed_retraces; /* retraces missed by late frames      */
+    unsigned long total_late_usec; /* sum of per-frame lateness           */
+    unsigned long max_late_usec;   /* worst per-frame lateness            */
+    unsigned long retrace_usec;	   /* measured/simulated retrace period   */
+};
+
 /* configure VGA for mode X; initializes logical view to (0,0) */
 extern int set_mode_X (void (*horiz_fill_fn)
                             (int, int, unsigned char[SCROLL_X_DIM]),
@@ -127,6 +157,27 @@ extern void set_view_window (int scr_x, int scr_y);
 /* show the logical view window on the monitor */
 extern void show_screen ();
 
+/* select presentation synchronization; returns 0 on success, -1 on failure */
+extern int set_vsync_mode (vsync_mode_t mode);
+
+/* read the frame presentation statistics */
+extern void get_present_stats (present_stats_t* stats);
+
+/* 
+ * touch every page of len bytes at addr (read and written back) so that
+ * later accesses do not fault; used by the low-jitter mode
+ */
+extern void prefault_pages (void* addr, unsigned long len);
+
+/* prefault the build buffer */
+extern void prefault_build_buffer ();
+
+/* 
+ * write count palette colors (6-bit RGB) starting at color first; deferred
+ * to the next vertical blanking interval when vsync is enabled
+ */
+extern void set_palette (int first, int count, unsigned char rgb[][3]);
+
 /* clear the video memory in mode X */
 extern void clear_screens ();
 
@@ -136,6 +187,26 @@ extern int draw_horiz_line (int y);
 /* draw a vertical line at horizontal pixel x within the logical view window */
 extern int draw_vert_line (int x);
 
+/* 
+ * size of a saved logical view window: the four planes of the scroll 
+ * region, SCROLL_X_WIDTH * SCROLL_Y_DIM bytes each, in build buffer order
+ */
+#define VIEW_SAVE_SIZE  (4 * SCROLL_X_WIDTH * SCROLL_Y_DIM)
+
+/* 
+ * A planar canvas holds a pre-rendered image of the whole logical space
+ * (or of its upper left part).  Pixel (x,y) is stored in plane x & 3 at
+ * canvas[(x & 3) * width * height + y * width + (x >> 2)], where width is
+ * in addresses.  While a canvas is set, draw_horiz_line and draw_vert_line
+ * copy lines that lie within it instead of calling the fill functions.
+ * Call with NULL to return to the fill functions.
+ */
+extern void set_canvas (const unsigned char* canvas, int width, int height);
+
+/* copy the planar image of the logical view window to/from buf */
+extern int save_view (unsigned char buf[VIEW_SAVE_SIZE]);
+extern int restore_view (const unsigned char buf[VIEW_SAVE_SIZE]);
+
 extern void draw_status_bar(const char * room, const char * status, const char * typed_text);
 
 
@@ -0,0 +1,768 @@
+/* tux-emu.c
+ * User-space emulator of the Tux controller, speaking MTCP (see mtcp.h)
+ * over a pseudo-terminal, so that the driver, the game and the receive
+ * path can be run and timed without the hardware.
+ *
+ * Usage: tux-emu [-b rate] [-m rate] [-R secs] [-s script [-l]] [-S seed]
+ *		  [-t secs] [-B]
+ *
+ * The emulator prints the name of the pty's slave side, which takes the
+ * place of /dev/ttyS0: with the driver loaded, run the game with
+ * TUX_TTY set to that name. It answers commands as the controller does
+ * (MTCP_ACK for MTCP_BIOC_ON, MTCP_BIOC_OFF, MTCP_DBG_OFF and
+ * MTCP_LED_SET, MTCP_POLL_OK for MTCP_POLL, the two LEDS_POLL packets for
+ * MTCP_POLL_LEDS, MTCP_RESET some time after MTCP_RESET_DEV, MTCP_ERROR
+ * for anything it doesn't know), and, like the controller, only sends
+ * button events after MTCP_BIOC_ON and mouse packets after MTCP_MOUSE_ON.
+ *
+ *	-b rate	 change a random button rate times a second
+ *	-m rate	 send rate random mouse movement packets a second
+ *	-R secs	 simulate the controller resetting every secs seconds
+ *	-s file	 play the events in file (see play_script), -l in a loop
+ *	-S seed	 seed for the random events
+ *	-t secs	 stop after secs seconds (5 with -B; otherwise never)
+ *	-B	 benchmark: connect to the emulator through tuxctl-rx.c, the
+ *		 line discipline's receive ring and parser, and report its
+ *		 throughput, the latency of each packet from the emulator's
+ *		 write to the parser, and the round trip of LED commands,
+ *		 which are sent one after another for as long as it runs
+ *
+ * A pty moves bytes as fast as the processes at either end, so the times
+ * measured are those of the software alone, without the controller's
+ * 9600 baud line. The emulator stops on SIGINT or SIGTERM and prints
+ * what it sent.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mtcp.h"
+#include "tuxctl-rx.h"
+
+#define NSEC_PER_SEC 1000000000ULL
+#define NSEC_PER_MSEC 1000000ULL
+
+/* time from MTCP_RESET_DEV (or a simulated reset) to MTCP_RESET */
+#define RESET_DELAY (20 * NSEC_PER_MSEC)
+
+/* packets whose send times the emulator keeps for the benchmark */
+#define BENCH_RING 4096
+
+/* log2 microsecond latency histogram buckets (the last for 2^14 us and
+ * more) */
+#define LAT_BUCKETS 16
+
+/* a line of a script (see play_script) */
+struct step {
+	unsigned long long delay;	/* ns after the previous step */
+	char what;			/* 'b'utton, 'm'ouse or 'r'eset */
+	int dx, dy;
+	unsigned char value;		/* buttons, or mouse buttons */
+};
+
+/* The emulated controller. */
+struct emu {
+	int fd;				/* master side of the pty */
+
+	unsigned char buttons;		/* active low, as for TUX_BUTTONS */
+	unsigned char mouse_buttons;	/* MOUSE_LEFT etc., 1 when down */
+	int bioc_on, mouse_on;
+	unsigned char led[4];
+
+	/* the command being received, and how many bytes it needs */
+	unsigned char cmd[8];
+	int cmd_len, cmd_need;
+
+	/* when each kind of event is next due (0 if never) */
+	unsigned long long next_bioc, next_mouse, next_reset, reset_due;
+	unsigned long long bioc_interval, mouse_interval, reset_interval;
+
+	struct step *script;
+	int n_steps, step, loop;
+	unsigned long long next_step;
+
+	unsigned int cmds, acks, errors, bioc_sent, mouse_sent, resets;
+	unsigned int dropped;		/* packets the pty had no room for */
+
+	/* shared with the benchmark: when each packet was sent */
+	struct bench_times *times;
+};
+
+struct bench_times {
+	unsigned int sent;
+	unsigned long long ns[BENCH_RING];
+};
+
+static volatile sig_atomic_t stop = 0;
+
+static unsigned long long now_ns(void);
+static void on_signal(int);
+static int open_pty(char *name, int len);
+static void send_packet(struct emu *e, unsigned char op,
+			unsigned char b1, unsigned char b2);
+static void send_bioc(struct emu *e);
+static void send_mouse(struct emu *e, int dx, int dy);
+static void device_reset(struct emu *e);
+static void handle_cmd(struct emu *e);
+static void rx_byte(struct emu *e, unsigned char c);
+static int read_script(struct emu *e, const char *file);
+static void play_script(struct emu *e, unsigned long long now);
+static void run_events(struct emu *e, unsigned long long now);
+static int run_emu(struct emu *e, unsigned long long end);
+static int run_bench(struct emu *e, const char *slave,
+		     unsigned long long end);
+
+
+static unsigned long long
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void
+on_signal(int sig)
+{
+	stop = 1;
+}
+
+/* open_pty()
+ * Opens a new pty and sets its slave side to raw mode, so that bytes pass
+ * through unchanged (and aren't echoed back) until a line discipline is
+ * attached. The slave stays open, so reads of the master side don't fail
+ * while no program has it open.
+ * Returns the master's file descriptor, with the slave's name in name, or
+ * -1 on failure.
+ */
+static int
+open_pty(char *name, int len)
+{
+	struct termios tio;
+	int fd, slave;
+
+	if (0 > (fd = posix_openpt(O_RDWR | O_NOCTTY)) ||
+	    0 != grantpt(fd) || 0 != unlockpt(fd) ||
+	    0 != ptsname_r(fd, name, len)) {
+		perror("tux-emu: pty");
+		return -1;
+	}
+	if (0 > (slave = open(name, O_RDWR | O_NOCTTY)) ||
+	    0 != tcgetattr(slave, &tio)) {
+		perror(name);
+		return -1;
+	}
+	cfmakeraw(&tio);
+	if (0 != tcsetattr(slave, TCSANOW, &tio)) {
+		perror(name);
+		return -1;
+	}
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	return fd;
+}
+
+/* send_packet()
+ * Sends one 3-byte response packet; the data bytes get their high bit
+ * set. A packet is dropped (and counted) if the pty has no room for it,
+ * as the controller doesn't wait for a reader, but one partly written is
+ * finished, so the stream stays in step.
+ */
+static void
+send_packet(struct emu *e, unsigned char op, unsigned char b1,
+	    unsigned char b2)
+{
+	unsigned char pkt[3] = { op, 0x80 | b1, 0x80 | b2 };
+	struct pollfd pfd = { e->fd, POLLOUT, 0 };
+	int n = 0, r;
+
+	if (NULL != e->times)
+		e->times->ns[e->times->sent % BENCH_RING] = now_ns();
+	while (n < 3) {
+		r = write(e->fd, pkt + n, 3 - n);
+		if (0 < r) {
+			n += r;
+		} else if (0 == n && EAGAIN == errno) {
+			e->dropped++;
+			return;
+		} else if (EAGAIN == errno || EINTR == errno) {
+			poll(&pfd, 1, -1);
+		} else {
+			perror("tux-emu: write");
+			stop = 1;
+			return;
+		}
+	}
+	if (NULL != e->times)
+		e->times->sent++;
+}
+
+/* send_bioc()
+ * Sends an MTCP_BIOC_EVENT with the current buttons, if button events
+ * are on.
+ */
+static void
+send_bioc(struct emu *e)
+{
+	if (!e->bioc_on)
+		return;
+	send_packet(e, MTCP_BIOC_EVENT, e->buttons & 0x0F, e->buttons >> 4);
+	e->bioc_sent++;
+}
+
+/* send_mouse()
+ * Sends a mouse packet moving dx right and dy up (each from -128 to 127),
+ * if mouse mode is on.
+ */
+static void
+send_mouse(struct emu *e, int dx, int dy)
+{
+	unsigned char op = 0x08 | e->mouse_buttons;
+
+	if (!e->mouse_on)
+		return;
+	if (0 > dx)
+		op |= MOUSE_XS;
+	if (0 > dy)
+		op |= MOUSE_YS;
+	send_packet(e, op, dx & 0x7F, dy & 0x7F);
+	e->mouse_sent++;
+}
+
+/* device_reset()
+ * The controller has re-initialized itself: button events and mouse mode
+ * are off, and it says so with MTCP_RESET.
+ */
+static void
+device_reset(struct emu *e)
+{
+	e->bioc_on = 0;
+	e->mouse_on = 0;
+	e->cmd_len = 0;
+	memset(e->led, 0, sizeof(e->led));
+	send_packet(e, MTCP_RESET, 0, 0);
+	e->resets++;
+}
+
+/* handle_cmd()
+ * Carries out the complete command in e->cmd and answers it.
+ */
+static void
+handle_cmd(struct emu *e)
+{
+	int i, n;
+
+	e->cmds++;
+	switch (e->cmd[0]) {
+	case MTCP_BIOC_ON:
+	case MTCP_BIOC_OFF:
+		e->bioc_on = (MTCP_BIOC_ON == e->cmd[0]);
+		/* fall through */
+	case MTCP_DBG_OFF:
+		send_packet(e, MTCP_ACK, 0, 0);
+		e->acks++;
+		break;
+	case MTCP_LED_SET:
+		for (i = 0, n = 2; i < 4; i++)
+			if (e->cmd[1] & (1 << i))
+				e->led[i] = e->cmd[n++];
+		send_packet(e, MTCP_ACK, 0, 0);
+		e->acks++;
+		break;
+	case MTCP_POLL:
+		send_packet(e, MTCP_POLL_OK, e->buttons & 0x0F,
+			    e->buttons >> 4);
+		break;
+	case MTCP_POLL_LEDS:
+		/* segment A (bit 7) of each LED goes in the opcode */
+		send_packet(e, MTCP_LEDS_POLL0 | (e->led[0] >> 7) |
+			    ((e->led[1] >> 7) << 1), e->led[0], e->led[1]);
+		send_packet(e, MTCP_LEDS_POLL1 | (e->led[2] >> 7) |
+			    ((e->led[3] >> 7) << 1), e->led[2], e->led[3]);
+		break;
+	case MTCP_RESET_DEV:
+		e->reset_due = now_ns() + RESET_DELAY;
+		break;
+	case MTCP_MOUSE_ON:
+	case MTCP_MOUSE_OFF:
+		e->mouse_on = (MTCP_MOUSE_ON == e->cmd[0]);
+		break;
+	default:
+		/* the clock and LED mode commands: accepted, no answer */
+		break;
+	}
+}
+
+/* rx_byte()
+ * Adds a byte received from the computer to the command being received,
+ * and carries the command out once it is complete.
+ */
+static void
+rx_byte(struct emu *e, unsigned char c)
+{
+	int i;
+
+	if (0 == e->cmd_len) {
+		if (MTCP_CMD_CHECK != (c & MTCP_CMD_CHECK_MASK) ||
+		    MTCP_POLL_LEDS < c) {
+			send_packet(e, MTCP_ERROR, 0, 0);
+			e->errors++;
+			return;
+		}
+		e->cmd_need = 1;
+		if (MTCP_CLK_SET == c || MTCP_CLK_MAX == c)
+			e->cmd_need = 3;
+		else if (MTCP_LED_SET == c)
+			e->cmd_need = 2;
+	}
+	e->cmd[e->cmd_len++] = c;
+	if (MTCP_LED_SET == e->cmd[0] && 2 == e->cmd_len)
+		for (i = 0; i < 4; i++)
+			if (c & (1 << i))
+				e->cmd_need++;
+	if (e->cmd_len == e->cmd_need) {
+		handle_cmd(e);
+		e->cmd_len = 0;
+	}
+}
+
+/* read_script()
+ * Reads a script of events, one per line, each a delay in milliseconds
+ * after the previous event followed by one of
+ *	bioc <buttons>		  the buttons change to <buttons> (in hex,
+ *				  active low, as returned by TUX_BUTTONS)
+ *	mouse <dx> <dy> [<mb>]	  movement, with mouse buttons <mb> down
+ *	reset			  the controller resets
+ * Blank lines and lines starting with # are ignored.
+ * Returns 0 on success, or -1 (with a message printed) on failure.
+ */
+static int
+read_script(struct emu *e, const char *file)
+{
+	char line[200], what[16];
+	unsigned int ms, value;
+	int dx, dy, n, lineno = 0;
+	struct step *s;
+	FILE *f;
+
+	if (NULL == (f = fopen(file, "r"))) {
+		perror(file);
+		return -1;
+	}
+	while (NULL != fgets(line, sizeof(line), f)) {
+		lineno++;
+		if ('#' == line[0] || 1 > sscanf(line, "%15s", what))
+			continue;
+		s = realloc(e->script, (e->n_steps + 1) * sizeof(*s));
+		if (NULL == s) {
+			fprintf(stderr, "%s: out of memory\n", file);
+			fclose(f);
+			return -1;
+		}
+		e->script = s;
+		s += e->n_steps;
+		value = 0;
+		n = sscanf(line, "%u %15s", &ms, what);
+		if (2 == n && 0 == strcmp(what, "bioc") &&
+		    3 == sscanf(line, "%u %15s %x", &ms, what, &value)) {
+			s->what = 'b';
+		} else if (2 == n && 0 == strcmp(what, "mouse") &&
+			   4 <= sscanf(line, "%u %15s %d %d %u", &ms, what,
+				       &dx, &dy, &value)) {
+			s->what = 'm';
+			s->dx = dx;
+			s->dy = dy;
+		} else if (2 == n && 0 == strcmp(what, "reset")) {
+			s->what = 'r';
+		} else {
+			fprintf(stderr, "%s:%d: bad event\n", file, lineno);
+			fclose(f);
+			return -1;
+		}
+		s->delay = ms * NSEC_PER_MSEC;
+		s->value = value;
+		e->n_steps++;
+	}
+	fclose(f);
+	return 0;
+}
+
+/* play_script()
+ * Plays the script's events that are due, starting it again at the end if
+ * looping.
+ */
+static void
+play_script(struct emu *e, unsigned long long now)
+{
+	struct step *s;
+
+	while (0 != e->next_step && e->next_step <= now) {
+		s = &e->script[e->step];
+		switch (s->what) {
+		case 'b':
+			e->buttons = s->value;
+			send_bioc(e);
+			break;
+		case 'm':
+			e->mouse_buttons = s->value & (MOUSE_LEFT |
+						       MOUSE_RIGHT |
+						       MOUSE_MIDDLE);
+			send_mouse(e, s->dx, s->dy);
+			break;
+		case 'r':
+			device_reset(e);
+			break;
+		}
+		if (++e->step == e->n_steps) {
+			e->step = 0;
+			if (!e->loop) {
+				e->next_step = 0;
+				break;
+			}
+		}
+		e->next_step += e->script[e->step].delay;
+		if (0 == e->next_step)
+			e->next_step = 1;
+	}
+}
+
+/* run_events()
+ * Sends the events that are due. Events falling behind (if the emulator
+ * couldn't run) are all sent at once, so the rates are kept on average.
+ */
+static void
+run_events(struct emu *e, unsigned long long now)
+{
+	for (; 0 != e->next_bioc && e->next_bioc <= now;
+	     e->next_bioc += e->bioc_interval) {
+		e->buttons ^= 1 << (rand() % 8);
+		send_bioc(e);
+	}
+	for (; 0 != e->next_mouse && e->next_mouse <= now;
+	     e->next_mouse += e->mouse_interval)
+		send_mouse(e, rand() % 17 - 8, rand() % 17 - 8);
+	if (0 != e->next_reset && e->next_reset <= now) {
+		e->next_reset += e->reset_interval;
+		e->reset_due = now + RESET_DELAY;
+	}
+	if (0 != e->reset_due && e->reset_due <= now) {
+		e->reset_due = 0;
+		device_reset(e);
+	}
+	play_script(e, now);
+}
+
+/* run_emu()
+ * Runs the emulator until time end (never if 0) or a signal, waiting for
+ * commands between the events.
+ * Returns 0 on success, or -1 on failure.
+ */
+static int
+run_emu(struct emu *e, unsigned long long end)
+{
+	unsigned long long now, next, due[5];
+	unsigned char buf[256];
+	struct pollfd pfd = { e->fd, POLLIN, 0 };
+	struct timespec ts;
+	sigset_t unblock;
+	int i, n;
+
+	sigemptyset(&unblock);
+	due[0] = end;
+	while (!stop) {
+		now = now_ns();
+		if (0 != end && end <= now)
+			break;
+		run_events(e, now);
+
+		/* sleep until the next event, or a command arrives */
+		due[1] = e->next_bioc;
+		due[2] = e->next_mouse;
+		due[3] = (0 != e->reset_due ? e->reset_due : e->next_reset);
+		due[4] = e->next_step;
+		for (i = 0, next = 0; i < 5; i++)
+			if (0 != due[i] && (0 == next || due[i] < next))
+				next = due[i];
+		now = now_ns();
+		if (next < now)
+			next = now;
+		ts.tv_sec = (next - now) / NSEC_PER_SEC;
+		ts.tv_nsec = (next - now) % NSEC_PER_SEC;
+		if (0 > ppoll(&pfd, 1, (0 != next ? &ts : NULL), &unblock)) {
+			if (EINTR == errno)
+				continue;
+			perror("tux-emu: poll");
+			return -1;
+		}
+		if (0 == (pfd.revents & POLLIN))
+			continue;
+		if (0 < (n = read(e->fd, buf, sizeof(buf))))
+			for (i = 0; i < n; i++)
+				rx_byte(e, buf[i]);
+	}
+	printf("tux-emu: %u commands (%u acknowledged, %u errors), "
+	       "%u button events, %u mouse packets, %u resets, "
+	       "%u packets dropped\n", e->cmds, e->acks, e->errors,
+	       e->bioc_sent, e->mouse_sent, e->resets, e->dropped);
+	return 0;
+}
+
+/* count_latency()
+ * Adds a latency to a log2 microsecond histogram, with its sum and most.
+ */
+static void
+count_latency(unsigned int *hist, unsigned long long *sum,
+	      unsigned long long *most, unsigned long long ns)
+{
+	int i;
+
+	for (i = 0; i < LAT_BUCKETS - 1 && ns >= (1000ULL << i); i++)
+		;
+	hist[i]++;
+	*sum += ns;
+	if (*most < ns)
+		*most = ns;
+}
+
+/* print_latency()
+ * Prints a histogram made by count_latency, leaving out empty buckets.
+ */
+static void
+print_latency(const char *what, const unsigned int *hist,
+	      unsigned long long sum, unsigned long long most)
+{
+	unsigned int n = 0;
+	int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++)
+		n += hist[i];
+	if (0 == n)
+		return;
+	printf("%s: %u, mean %.1f us, max %.1f us\n", what, n,
+	       sum / 1000.0 / n, most / 1000.0);
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		if (0 == hist[i])
+			continue;
+		if (LAT_BUCKETS - 1 == i)
+			printf("  >= %-6u us %u\n", 1U << (i - 1), hist[i]);
+		else
+			printf("  <  %-6u us %u\n", 1U << i, hist[i]);
+	}
+}
+
+/* send_cmd()
+ * Sends a command from the benchmark's side of the pty.
+ */
+static void
+send_cmd(int fd, const unsigned char *cmd, int len)
+{
+	if (len != write(fd, cmd, len))
+		perror("tux-bench: write");
+}
+
+/* run_bench()
+ * Runs the emulator in a child process and, in this one, acts as the
+ * driver on the slave side: turns on button events and mouse mode, then
+ * sends LED updates one at a time, each as the previous one is
+ * acknowledged, while passing what arrives through the line discipline's
+ * ring and parser (tuxctl-rx.c) until time end.
+ * Returns the program's exit status.
+ */
+static int
+run_bench(struct emu *e, const char *slave, unsigned long long end)
+{
+	static const unsigned char led_cmd[6] = {
+		MTCP_LED_SET, 0x0F, 0xE7, 0x06, 0xCB, 0x8F
+	};
+	unsigned char start[2] = { MTCP_BIOC_ON, MTCP_MOUSE_ON };
+	unsigned char packets[TUXCTL_RX_MAX_PACKETS][TUXCTL_PACKET_LEN];
+	unsigned char buf[4096];
+	unsigned int pkt_hist[LAT_BUCKETS] = { 0 };
+	unsigned int rtt_hist[LAT_BUCKETS] = { 0 };
+	unsigned long long pkt_sum = 0, pkt_most = 0, rtt_sum = 0, rtt_most = 0;
+	unsigned long long begin, now, sent, led_sent = 0;
+	unsigned int received = 0, bioc = 0, mouse = 0, acks = 0, other = 0;
+	static tuxctl_rx_t rx;
+	struct pollfd pfd;
+	struct timespec ts;
+	sigset_t unblock;
+	int fd, n, i, len, off, status, acks_wanted;
+	pid_t pid;
+
+	e->times = mmap(NULL, sizeof(*e->times), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == e->times) {
+		perror("tux-emu: mmap");
+		return 1;
+	}
+	if (0 > (fd = open(slave, O_RDWR | O_NOCTTY))) {
+		perror(slave);
+		return 1;
+	}
+	if (0 > (pid = fork())) {
+		perror("tux-emu: fork");
+		return 1;
+	}
+	if (0 == pid) {
+		close(fd);
+		exit(0 == run_emu(e, 0) ? 0 : 1);
+	}
+
+	tuxctl_rx_init(&rx);
+	sigemptyset(&unblock);
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	begin = now_ns();
+	send_cmd(fd, start, sizeof(start));
+	acks_wanted = 1; // for MTCP_BIOC_ON
+	len = off = 0;
+	while (!stop && (now = now_ns()) < end) {
+		if (0 == acks_wanted) {
+			led_sent = now;
+			send_cmd(fd, led_cmd, sizeof(led_cmd));
+			acks_wanted = 1;
+		}
+		if (off == len) {
+			ts.tv_sec = (end - now) / NSEC_PER_SEC;
+			ts.tv_nsec = (end - now) % NSEC_PER_SEC;
+			if (0 >= ppoll(&pfd, 1, &ts, &unblock))
+				continue;
+			if (0 >= (len = read(fd, buf, sizeof(buf))))
+				break;
+			off = 0;
+		}
+		/* as the line discipline does, a ringful at a time */
+		n = buf_room(rx.start, rx.end);
+		if (n > len - off)
+			n = len - off;
+		tuxctl_rx_put(&rx, buf + off, n);
+		off += n;
+		n = tuxctl_rx_parse(&rx, packets);
+		now = now_ns();
+		for (i = 0; i < n; i++, received++) {
+			sent = e->times->ns[received % BENCH_RING];
+			count_latency(pkt_hist, &pkt_sum, &pkt_most,
+				      now - sent);
+			if (MTCP_IS_MOUSE(packets[i][0])) {
+				mouse++;
+			} else if (MTCP_BIOC_EVENT == packets[i][0]) {
+				bioc++;
+			} else if (MTCP_ACK == packets[i][0]) {
+				acks++;
+				if (0 != led_sent)
+					count_latency(rtt_hist, &rtt_sum,
+						      &rtt_most,
+						      now - led_sent);
+				acks_wanted = 0;
+			} else {
+				other++;
+				if (MTCP_RESET == packets[i][0]) {
+					/* start again, as the driver does */
+					send_cmd(fd, start, sizeof(start));
+					led_sent = 0;
+					acks_wanted = 1;
+				}
+			}
+		}
+	}
+	now = now_ns();
+	kill(pid, SIGTERM);
+	waitpid(pid, &status, 0);
+
+	printf("tux-bench: %.2f s, %u packets received (%.0f/s): %u button "
+	       "events, %u mouse, %u ACKs, %u other\n",
+	       (now - begin) / 1e9, received,
+	       received * 1e9 / (now - begin), bioc, mouse, acks, other);
+	printf("tux-bench: %u framing errors, %u resyncs, %u bytes "
+	       "overrun\n", rx.framing_errors, rx.resyncs, rx.overruns);
+	print_latency("packet latency (emulator to parser)", pkt_hist,
+		      pkt_sum, pkt_most);
+	print_latency("LED command round trip", rtt_hist, rtt_sum, rtt_most);
+	return (WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+}
+
+int
+main(int argc, char **argv)
+{
+	static struct emu e;
+	char slave[64];
+	const char *script = NULL;
+	double bioc_rate = 0, mouse_rate = 0, reset_secs = 0, secs = 0;
+	unsigned long long now, end = 0;
+	struct sigaction sa;
+	sigset_t block;
+	int bench = 0, c;
+
+	srand(time(NULL));
+	while (-1 != (c = getopt(argc, argv, "b:m:R:s:lS:t:B"))) {
+		switch (c) {
+		case 'b': bioc_rate = atof(optarg); break;
+		case 'm': mouse_rate = atof(optarg); break;
+		case 'R': reset_secs = atof(optarg); break;
+		case 's': script = optarg; break;
+		case 'l': e.loop = 1; break;
+		case 'S': srand(atoi(optarg)); break;
+		case 't': secs = atof(optarg); break;
+		case 'B': bench = 1; break;
+		default:
+			fprintf(stderr, "usage: %s [-b rate] [-m rate] "
+				"[-R secs] [-s script [-l]] [-S seed] "
+				"[-t secs] [-B]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (NULL != script && 0 != read_script(&e, script))
+		return 1;
+	if (0 > (e.fd = open_pty(slave, sizeof(slave))))
+		return 1;
+
+	/* SIGINT and SIGTERM are only taken while waiting in ppoll, so
+	 * one arriving just before can't be missed */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigemptyset(&block);
+	sigaddset(&block, SIGINT);
+	sigaddset(&block, SIGTERM);
+	sigprocmask(SIG_BLOCK, &block, NULL);
+
+	e.buttons = 0xFF;
+	now = now_ns();
+	if (0 < bioc_rate) {
+		e.bioc_interval = NSEC_PER_SEC / bioc_rate + 1;
+		e.next_bioc = now + e.bioc_interval;
+	}
+	if (0 < mouse_rate) {
+		e.mouse_interval = NSEC_PER_SEC / mouse_rate + 1;
+		e.next_mouse = now + e.mouse_interval;
+	}
+	if (0 < reset_secs) {
+		e.reset_interval = reset_secs * NSEC_PER_SEC + 1;
+		e.next_reset = now + e.reset_interval;
+	}
+	if (0 < e.n_steps)
+		e.next_step = now + e.script[0].delay;
+	if (bench && 0 == secs)
+		secs = 5;
+	if (0 < secs)
+		end = now + secs * NSEC_PER_SEC;
+
+	if (bench)
+		return run_bench(&e, slave, end);
+	printf("tux-emu: controller on %s\n", slave);
+	fflush(stdout);
+	return (0 == run_emu(&e, end) ? 0 : 1);
+}
@@ -0,0 +1,155 @@
+/* tuxctl-evq.c
+ * Queue of timestamped button events for the Tux controller driver (see
+ * tuxctl-evq.h).
+ */
+
+#if defined(__KERNEL__)
+#include <linux/ioctl.h>
+#else
+#include <sys/ioctl.h>
+#endif
+
+#include "tuxctl-evq.h"
+
+/* Set TUXCTL_EVQ_TEST to 1 (see the evq-test target in the Makefile) to
+ * build a user program that checks the queue logic.
+ */
+#if !defined(TUXCTL_EVQ_TEST)
+#define TUXCTL_EVQ_TEST 0
+#endif
+
+#define evq_used(q) ((q)->tail - (q)->head)
+#define evq_slot(idx) ((idx) & (TUXCTL_EVQ_LEN - 1))
+
+
+void
+tuxctl_evq_init(tuxctl_evq_t *q)
+{
+	q->head = 0;
+	q->tail = 0;
+	q->seq = 0;
+	q->lost = 0;
+}
+
+void
+tuxctl_evq_push(tuxctl_evq_t *q, unsigned char buttons,
+		unsigned long long time_ns)
+{
+	struct tux_event *e;
+
+	if (TUXCTL_EVQ_LEN == evq_used(q)) {
+		q->head++;
+		q->lost++;
+	}
+	e = &q->ev[evq_slot(q->tail)];
+	e->time_ns = time_ns;
+	e->seq = q->seq++;
+	e->buttons = buttons;
+	e->pad[0] = e->pad[1] = e->pad[2] = 0;
+	q->tail++;
+}
+
+int
+tuxctl_evq_pop(tuxctl_evq_t *q, struct tux_event *ev, int max,
+	       unsigned int *lost)
+{
+	int n = 0;
+
+	while (n < max && 0 != evq_used(q)) {
+		ev[n++] = q->ev[evq_slot(q->head)];
+		q->head++;
+	}
+	*lost = q->lost;
+	q->lost = 0;
+	return n;
+}
+
+int
+tuxctl_evq_empty(const tuxctl_evq_t *q)
+{
+	return (0 == evq_used(q));
+}
+
+
+#if (TUXCTL_EVQ_TEST == 1)
+
+#include <stdio.h>
+
+static int failures = 0;
+
+#define check(cond) \
+	do { \
+		if (!(cond)) { \
+			printf("%s:%d: check failed: %s\n", __FILE__, \
+			       __LINE__, #cond); \
+			failures++; \
+		} \
+	} while (0)
+
+int
+main()
+{
+	static tuxctl_evq_t q;
+	struct tux_event ev[TUX_EVENT_BATCH];
+	unsigned int lost;
+	int i, n;
+
+	/* An empty queue returns nothing. */
+	tuxctl_evq_init(&q);
+	check(tuxctl_evq_empty(&q));
+	check(0 == tuxctl_evq_pop(&q, ev, TUX_EVENT_BATCH, &lost));
+	check(0 == lost);
+
+	/* Events come out in order, with their states, times, and sequence
+	 * numbers, in batches no larger than asked for. */
+	for (i = 0; i < 20; i++)
+		tuxctl_evq_push(&q, 0xFF - i, 1000ULL * i);
+	check(!tuxctl_evq_empty(&q));
+	n = tuxctl_evq_pop(&q, ev, 5, &lost);
+	check(5 == n && 0 == lost);
+	for (i = 0; i < n; i++) {
+		check(0xFF - i == ev[i].buttons);
+		check(1000ULL * i == ev[i].time_ns);
+		check((unsigned int)i == ev[i].seq);
+	}
+	n = tuxctl_evq_pop(&q, ev, TUX_EVENT_BATCH, &lost);
+	check(15 == n && 0 == lost && 5 == ev[0].seq && 19 == ev[14].seq);
+	check(tuxctl_evq_empty(&q));
+
+	/* Overflow drops the oldest events and reports how many, once. */
+	for (i = 0; i < TUXCTL_EVQ_LEN + 10; i++)
+		tuxctl_evq_push(&q, i, i);
+	n = tuxctl_evq_pop(&q, ev, 1, &lost);
+	check(1 == n && 10 == lost && 30 == ev[0].seq && 10 == ev[0].buttons);
+	n = tuxctl_evq_pop(&q, ev, 1, &lost);
+	check(1 == n && 0 == lost && 31 == ev[0].seq);
+	while (0 != tuxctl_evq_pop(&q, ev, TUX_EVENT_BATCH, &lost))
+		;
+	check(tuxctl_evq_empty(&q));
+	tuxctl_evq_push(&q, 0x7F, 42);
+	n = tuxctl_evq_pop(&q, ev, TUX_EVENT_BATCH, &lost);
+	check(1 == n && 0x7F == ev[0].buttons &&
+	      TUXCTL_EVQ_LEN + 30 == ev[0].seq);
+
+	/* The indices wrap around without losing events. */
+	q.head = q.tail = 0xFFFFFFF0U;
+	for (i = 0; i < 40; i++)
+		tuxctl_evq_push(&q, i, i);
+	for (i = 0; i < 40; i += n) {
+		n = tuxctl_evq_pop(&q, ev, TUX_EVENT_BATCH, &lost);
+		check(0 < n && 0 == lost && (unsigned char)i == ev[0].buttons);
+	}
+	check(tuxctl_evq_empty(&q));
+
+	/* The event layout is the same for 32- and 64-bit programs. */
+	check(16 == sizeof(struct tux_event));
+
+	if (0 != failures) {
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("event queue checks passed\n");
+	return 0;
+}
+
+#endif /* TUXCTL_EVQ_TEST */
@@ -0,0 +1,56 @@
+#ifndef TUXCTL_EVQ_H
+#define TUXCTL_EVQ_H
+
+/* tuxctl-evq.h
+ * Queue of timestamped button events for the Tux controller driver.
+ *
+ * Button events are pushed by the driver as MTCP_BIOC_EVENT packets
+ * arrive (in interrupt context) and removed in batches by the
+ * TUX_READ_EVENTS ioctl. The queue is a ring of TUXCTL_EVQ_LEN events;
+ * when it is full, the oldest event is dropped, so that the newest
+ * (current) button state is never lost. The queue does no locking of
+ * its own; the driver holds the controller's device lock around every
+ * call.
+ *
+ * The same code builds as a user program (see the evq-test target in the
+ * Makefile) to check the queue logic off-hardware.
+ */
+
+#include "tuxctl-ioctl.h"
+
+#define TUXCTL_EVQ_LEN 64	/* must be a power of two */
+
+typedef struct tuxctl_evq {
+	struct tux_event ev[TUXCTL_EVQ_LEN];
+	unsigned int head;	/* index of oldest event (free-running) */
+	unsigned int tail;	/* index of next free slot (free-running) */
+	unsigned int seq;	/* sequence number for next event */
+	unsigned int lost;	/* events dropped since last tuxctl_evq_pop */
+} tuxctl_evq_t;
+
+/* tuxctl_evq_init()
+ * Empty the queue and restart its sequence numbers.
+ */
+extern void tuxctl_evq_init(tuxctl_evq_t *q);
+
+/* tuxctl_evq_push()
+ * Add an event with the given button state and time, dropping the oldest
+ * event if the queue is full.
+ */
+extern void tuxctl_evq_push(tuxctl_evq_t *q, unsigned char buttons,
+			    unsigned long long time_ns);
+
+/* tuxctl_evq_pop()
+ * Remove up to max of the oldest events into ev[]. Returns the number
+ * removed; *lost is set to the number of events dropped since the last
+ * call (and the count is cleared).
+ */
+extern int tuxctl_evq_pop(tuxctl_evq_t *q, struct tux_event *ev, int max,
+			  unsigned int *lost);
+
+/* tuxctl_evq_empty()
+ * Returns non-zero if no events are queued.
+ */
+extern int tuxctl_evq_empty(const tuxctl_evq_t *q);
+
+#endif
@@ -21,19 +21,29 @@
 #include <linux/kdev_t.h>
 #include <linux/tty.h>
 #include <linux/spinlock.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/timer.h>
+#include <linux/jiffies.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <asm/atomic.h>
 
 #include "tuxctl-ld.h"
 #include "tuxctl-ioctl.h"
+#include "tuxctl-evq.h"
 #include "mtcp.h"
 
+#define CREATE_TRACE_POINTS
+#include "tuxctl-trace.h"
+
 #define debug(str, ...) \
 	printk(KERN_DEBUG "%s: " str, __FUNCTION__, ## __VA_ARGS__)
 
-	/* global variables */
-	static unsigned char button_press;
-	static unsigned int led_save; // save the state of the LED
-	static int reset_flag = 0; // flag used to check reset
-
 	//hard code the hex for the seven segment display
 	static unsigned char hex_led[16] =
 	{ 0xE7, 0x06, 0xCB, 0x8F,
@@ -43,62 +53,423 @@
 	};
 
 #define CLEARIT 0x000F0000
-	/* declare some locks */
-	spinlock_t lock;
+
+	/* Command pipeline. Only one command that the controller answers
+	 * with MTCP_ACK is on the line at a time; the next is sent when the
+	 * ACK arrives (or ACK_TIMEOUT jiffies later, if it never does, when
+	 * ack_timer fires). A command that doesn't fit in the line
+	 * discipline's transmit buffer is retried when the buffer drains, or
+	 * at the next tick at the latest.
+	 * Other commands wait in cmd_q, and LED updates wait in led_buf,
+	 * where a newer update replaces one not yet sent. Commands that
+	 * get no answer (the clock commands) go out as soon as they reach
+	 * the head of the queue. */
+#define CMD_Q_LEN 8
+#define CMD_MAX_LEN 6
+#define ACK_TIMEOUT (HZ / 10)
+	struct tux_cmd {
+		unsigned char len;
+		unsigned char ack; // the controller answers with MTCP_ACK
+		unsigned char buf[CMD_MAX_LEN];
+	};
+
+	/* Counters for debugging, shown in debugfs (see tuxctl_debug_show):
+	 * packets received by type (see rx_type), controller resets, the
+	 * time from sending a command to its MTCP_ACK in log2 millisecond
+	 * buckets (the first under 1 ms, the last 2^(RTT_BUCKETS-2) ms or
+	 * more), and ioctl calls by number, starting at TUX_SET_LED, which
+	 * are counted without the device lock. */
+#define RX_TYPES 8
+#define RTT_BUCKETS 9
+#define IOCTL_FIRST 0x10
+#define IOCTL_COUNT 13
+	struct tuxctl_debug {
+		unsigned int rx[RX_TYPES];
+		unsigned int resets;
+		unsigned int rtt[RTT_BUCKETS];
+		unsigned long long cmd_sent; // ns, for the command in flight
+		atomic_t ioctls[IOCTL_COUNT];
+		atomic_t ioctls_bad; // not a tuxctl ioctl
+		unsigned long since; // jiffies when counting started
+	};
+
+	static const char* const rx_names[RX_TYPES] = {
+		"ACK", "BIOC_EVENT", "RESET", "mouse",
+		"CLK_EVENT", "POLL_OK", "ERROR", "other"
+	};
+
+	static const char* const ioctl_names[IOCTL_COUNT] = {
+		"TUX_SET_LED", "TUX_READ_LED", "TUX_BUTTONS", "TUX_INIT",
+		"TUX_LED_REQUEST", "TUX_LED_ACK", "TUX_READ_EVENTS",
+		"TUX_GET_STATS", "TUX_GET_STATE_OFFSET", "TUX_SET_CLOCK",
+		"TUX_SET_ANIM", "TUX_SET_MOUSE", "TUX_READ_MOUSE"
+	};
+
+	/* The state of one controller. Each tty with the line discipline
+	 * attached has its own (see tuxctl_ldisc_dev), so controllers on
+	 * different serial ports never share data or locks. Everything is
+	 * protected by lock, taken with interrupts off, as packets are
+	 * handled in the receive interrupt. */
+	struct tuxctl_dev {
+		spinlock_t lock;
+		unsigned char button_press;
+		unsigned long long button_time; // when button_press changed
+		unsigned int led_save; // save the state of the LED
+		int led_valid; // led_save has been set since init
+
+		/* button events waiting for TUX_READ_EVENTS, and the
+		 * readers sleeping in poll/select until one arrives */
+		tuxctl_evq_t evq;
+		wait_queue_head_t evq_wait;
+
+		struct tux_cmd cmd_q[CMD_Q_LEN];
+		unsigned int cmd_head, cmd_tail; // free-running indices
+		int cmd_in_flight; // waiting for an ACK
+		unsigned long cmd_sent_at; // jiffies when it was sent
+		int tx_blocked; // the transmit buffer was full
+		struct timer_list ack_timer; // runs send_cmds (see ack_tick)
+		int led_pending; // led_buf waiting to be sent
+		unsigned char led_buf[CMD_MAX_LEN];
+		struct tux_stats stats;
+
+		/* clock mode (TUX_SET_CLOCK): the controller's clock showed
+		 * clock_base seconds at clock_start (jiffies) */
+		int clock_on;
+		unsigned long clock_base;
+		unsigned long clock_start;
+
+		/* animation (TUX_SET_ANIM), played by anim_timer: frame
+		 * anim_frame of anim is shown, with anim_left more plays
+		 * of the sequence after this one (if anim.repeat != 0) */
+		int anim_on;
+		struct tux_anim anim;
+		unsigned int anim_frame;
+		unsigned int anim_left;
+		struct hrtimer anim_timer;
+
+		/* mouse mode (TUX_SET_MOUSE), and the movement received
+		 * since the last TUX_READ_MOUSE */
+		int mouse_on;
+		struct tux_mouse mouse;
+
+		struct tty_struct* tty; // for sending from anim_timer
+
+		/* the page user space maps (see publish_state), and its
+		 * index in devs[] */
+		struct tux_state* state;
+		int index;
+
+		/* debugging counters, and their debugfs directory and file */
+		struct tuxctl_debug dbg;
+		atomic_t tx_lost; // see tuxctl_dev_tx_lost
+		struct dentry* debugfs_dir;
+		struct dentry* debugfs_stats;
+	};
+
+	/* the duration of an animation frame, as a ktime_t */
+#define anim_interval(ms) \
+	ktime_set((ms) / 1000, ((ms) % 1000) * NSEC_PER_MSEC)
+
+	/* The controllers with state pages, by index; the page of devs[i]
+	 * is mapped at offset i pages of the state device. devs_lock is
+	 * only taken when a controller is attached or detached, or its
+	 * page is mapped. */
+#define TUXCTL_MAX_DEVS 8
+	static struct tuxctl_dev* devs[TUXCTL_MAX_DEVS];
+	static spinlock_t devs_lock = SPIN_LOCK_UNLOCKED;
+
+	/* the debugfs directory holding one directory per controller, or
+	 * NULL if debugfs is unavailable */
+	static struct dentry* debugfs_root;
 
 
 	/* Helper Function Declartions */
 
 	/* Initial tux controller */
-	void tux_init(struct tty_struct *);
-	/* handle the button interrupt */
-	void handle_bioc(unsigned char, unsigned char );
+	void tux_init(struct tuxctl_dev *, struct tty_struct *);
+	/* handle the button interrupt (call with the device lock held) */
+	void handle_bioc(struct tuxctl_dev *, unsigned char, unsigned char,
+			 unsigned long long);
 	/* copies parsed button value into user space */
-	int buttons(struct tty_struct * , unsigned long );
-	/* helper function to reinitialize and resture TUX on reset */
-	void reset(struct tty_struct *);
+	int buttons(struct tuxctl_dev *, unsigned long );
+	/* handle a mouse movement packet (call with the device lock held) */
+	void handle_mouse(struct tuxctl_dev *, const unsigned char *);
+	/* turns mouse mode on or off */
+	int set_mouse(struct tuxctl_dev *, struct tty_struct *, unsigned long);
+	/* copies the movement received into user space */
+	int read_mouse(struct tuxctl_dev *, unsigned long);
+	/* copies a batch of queued button events into user space */
+	int read_events(struct tuxctl_dev *, unsigned long);
+	/* helper function to reinitialize and resture TUX on reset (call
+	 * with the device lock held) */
+	void reset(struct tuxctl_dev *, struct tty_struct *);
 	/* helper function to set LED in the TUX */
-	int set_LED(struct tty_struct* tty, unsigned long arg);
+	int set_LED(struct tuxctl_dev *, struct tty_struct* tty,
+		    unsigned long arg);
 	/* helper function that clears the leds */
-	void clear_LED(struct tty_struct* tty);
+	void clear_LED(struct tuxctl_dev *);
+	/* builds the MTCP_LED_SET packet for a TUX_SET_LED argument */
+	void led_packet(unsigned long arg, unsigned char* buf);
+	/* hands the LEDs to the controller's clock, or takes them back */
+	int set_clock(struct tuxctl_dev *, struct tty_struct* tty,
+		      unsigned long arg);
+	/* plays an animation on the LEDs, or stops it */
+	int set_anim(struct tuxctl_dev *, struct tty_struct* tty,
+		     unsigned long arg);
+	void stop_anim(struct tuxctl_dev *);
+	static enum hrtimer_restart anim_tick(struct hrtimer *);
+	/* pipeline helpers (call with the device lock held) */
+	void queue_cmd(struct tuxctl_dev *, const unsigned char* buf, int len,
+		       int ack);
+	void queue_clock(struct tuxctl_dev *);
+	void send_cmds(struct tuxctl_dev *, struct tty_struct* tty);
+	static void ack_tick(unsigned long);
+	void restart_device(struct tuxctl_dev *, struct tty_struct* tty);
+	/* copies the controller's state into its page (call with the
+	 * device lock held) */
+	void publish_state(struct tuxctl_dev *);
+	/* copies the pipeline counters into user space */
+	int get_stats(struct tuxctl_dev *, unsigned long arg);
+	/* debugging counter helpers */
+	int rx_type(unsigned char);
+	void count_ack(struct tuxctl_dev *, unsigned long long);
+	void debugfs_add(struct tuxctl_dev *, struct tty_struct *);
+
+
+/*
+ * tuxctl_dev_alloc(struct tty_struct* tty)
+ * Description: Allocates the state for a newly attached controller, with
+ * an empty event queue and command pipeline, and gives it a state page.
+ * The device itself is set up by TUX_INIT.
+ * Inputs: tty - the controller's tty
+ * Outputs: None
+ * Returns: the new state, or NULL if out of memory or if TUXCTL_MAX_DEVS
+ *			controllers are already attached
+ * Side Effects: None
+ */
+struct tuxctl_dev* tuxctl_dev_alloc(struct tty_struct* tty)
+{
+	struct tuxctl_dev* dev;
+	int i;
+
+	dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+	if (dev == NULL)
+		return NULL;
+	dev->state = (struct tux_state*)get_zeroed_page(GFP_KERNEL);
+	if (dev->state == NULL) {
+		kfree(dev);
+		return NULL;
+	}
+	spin_lock_init(&dev->lock);
+	init_waitqueue_head(&dev->evq_wait);
+	tuxctl_evq_init(&dev->evq);
+	hrtimer_init(&dev->anim_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	dev->anim_timer.function = anim_tick;
+	setup_timer(&dev->ack_timer, ack_tick, (unsigned long)dev);
+	dev->tty = tty;
+	dev->button_press = 0xFF;
+	dev->led_save = CLEARIT;
+	dev->dbg.since = jiffies;
+	publish_state(dev);
+
+	spin_lock(&devs_lock);
+	for (i = 0; i < TUXCTL_MAX_DEVS && devs[i] != NULL; i++)
+		;
+	if (i < TUXCTL_MAX_DEVS) {
+		dev->index = i;
+		devs[i] = dev;
+	}
+	spin_unlock(&devs_lock);
+	if (i == TUXCTL_MAX_DEVS) {
+		free_page((unsigned long)dev->state);
+		kfree(dev);
+		return NULL;
+	}
+	debugfs_add(dev, tty);
+	return dev;
+}
+
+/*
+ * tuxctl_dev_free(struct tuxctl_dev* dev)
+ * Description: Frees a controller's state when the line discipline is
+ * detached from its tty.
+ * Inputs: dev - the state, or NULL
+ * Outputs: None
+ * Returns: None
+ * Side Effects: The state page lives on (unchanging) while user space
+ *				 still has it mapped
+ */
+void tuxctl_dev_free(struct tuxctl_dev* dev)
+{
+	if (dev == NULL)
+		return;
+	/* anim_tick may arm ack_timer, so stop it first */
+	hrtimer_cancel(&dev->anim_timer);
+	del_timer_sync(&dev->ack_timer);
+	debugfs_remove(dev->debugfs_stats);
+	debugfs_remove(dev->debugfs_dir);
+	spin_lock(&devs_lock);
+	devs[dev->index] = NULL;
+	spin_unlock(&devs_lock);
+	free_page((unsigned long)dev->state);
+	kfree(dev);
+}
+
+/*
+ * tuxctl_state_mmap(struct file* file, struct vm_area_struct* vma)
+ * Description: mmap for the state device: maps the state page of the
+ * controller whose index is the page offset, read-only.
+ * Inputs:	file - the state device
+ *			vma - the mapping, which must be one page and not
+ *				  writable
+ * Outputs: None
+ * Returns:	0 on success; -EINVAL for a bad size, -EPERM for a writable
+ *			mapping, -ENXIO if no controller has that index
+ * Side Effects: None
+ */
+static int tuxctl_state_mmap(struct file* file, struct vm_area_struct* vma)
+{
+	struct page* page = NULL;
+	int err;
+
+	if (vma->vm_end - vma->vm_start != PAGE_SIZE)
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	/* vm_insert_page may sleep, so hold a reference to the page
+	 * rather than the lock while inserting it */
+	spin_lock(&devs_lock);
+	if (vma->vm_pgoff < TUXCTL_MAX_DEVS && devs[vma->vm_pgoff] != NULL) {
+		page = virt_to_page(devs[vma->vm_pgoff]->state);
+		get_page(page);
+	}
+	spin_unlock(&devs_lock);
+	if (page == NULL)
+		return -ENXIO;
+
+	err = vm_insert_page(vma, vma->vm_start, page);
+	put_page(page);
+	return err;
+}
+
+static const struct file_operations tuxctl_state_fops = {
+	.owner = THIS_MODULE,
+	.mmap = tuxctl_state_mmap,
+};
+
+static struct miscdevice tuxctl_state_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "tuxctl",
+	.fops = &tuxctl_state_fops,
+};
+
+/*
+ * tuxctl_state_init(), tuxctl_state_exit()
+ * Description: Register and remove the state device (TUX_STATE_DEVICE).
+ * Inputs: None
+ * Outputs: None
+ * Returns:	tuxctl_state_init returns 0 on success or an error code
+ * Side Effects: None
+ */
+int tuxctl_state_init(void)
+{
+	return misc_register(&tuxctl_state_dev);
+}
+
+void tuxctl_state_exit(void)
+{
+	misc_deregister(&tuxctl_state_dev);
+}
+
+/*
+ * publish_state(struct tuxctl_dev* dev)
+ * Description: Copies the button state, event count, LED value and mouse
+ * packet count into the state page, inside the page's sequence lock (see
+ * tuxctl-ioctl.h). Call with the device lock held, which keeps writers
+ * apart.
+ * Inputs: dev - the controller's state
+ * Outputs: None
+ * Returns: None
+ * Side Effects: None
+ */
+void publish_state(struct tuxctl_dev* dev)
+{
+	struct tux_state* st = dev->state;
+
+	st->seq++;
+	smp_wmb();
+	st->buttons = dev->button_press;
+	st->event_seq = dev->evq.seq;
+	st->time_ns = dev->button_time;
+	st->led = dev->led_save;
+	st->mouse_packets = dev->mouse.packets;
+	smp_wmb();
+	st->seq++;
+}
 
 
 /************************ Protocol Implementation *************************/
 
-/* tuxctl_handle_packet()
+/* tuxctl_handle_packets()
  * IMPORTANT : Read the header for tuxctl_ldisc_data_callback() in 
  * tuxctl-ld.c. It calls this function, so all warnings there apply 
  * here as well.
+ *
+ * The whole batch is handled under one acquisition of the device lock:
+ * button events are queued with one timestamp (they arrived together),
+ * commands are sent once at the end, and pollers are woken up once.
  */
-void tuxctl_handle_packet (struct tty_struct* tty, unsigned char* packet)
-{
-    unsigned a, b, c;
-
-    a = packet[0]; /* Avoid printk() sign extending the 8-bit */
-    b = packet[1]; /* values when printing them. */
-    c = packet[2];
-
-    switch(a)
-    {
-    	case MTCP_BIOC_EVENT:
-    		handle_bioc(b,c);
-    		break;
-    	case MTCP_ACK:
-    		/* checks if reset flag is set, if it is, set the leds */
-    		if(reset_flag == 1)
-    		{
-    			reset_flag = 0;
-    			set_LED(tty, led_save);
-    		}
-    		break;
-    	case MTCP_RESET:
-    		reset(tty);
-    		break;
-    	default:
-    		break;
+void tuxctl_handle_packets (struct tty_struct* tty,
+			    unsigned char packets[][TUXCTL_PACKET_LEN], int n)
+{
+    struct tuxctl_dev* dev = tuxctl_ldisc_dev(tty);
+    unsigned long long now;
+    unsigned long flags;
+    int i, events = 0, acked = 0;
+
+    if (dev == NULL)
+    	return;
+
+    now = ktime_to_ns(ktime_get());
+    spin_lock_irqsave(&dev->lock, flags);
+    for (i = 0; i < n; i++) {
+	trace_tuxctl_packet_rx(dev->index, packets[i]);
+	dev->dbg.rx[rx_type(packets[i][0])]++;
+	if (MTCP_IS_MOUSE(packets[i][0])) {
+	    handle_mouse(dev, packets[i]);
+	    events = 1;
+	    continue;
+	}
+	switch(packets[i][0])
+	{
+	    case MTCP_BIOC_EVENT:
+		handle_bioc(dev, packets[i][1], packets[i][2], now);
+		events = 1;
+		break;
+	    case MTCP_ACK:
+		/* the command in flight is done */
+		if (dev->cmd_in_flight)
+		    count_ack(dev, now);
+		dev->cmd_in_flight = 0;
+		dev->stats.acks++;
+		acked = 1;
+		break;
+	    case MTCP_RESET:
+		dev->dbg.resets++;
+		reset(dev, tty);
+		break;
+	    default:
+		break;
+	}
     }
+    if (acked)
+	send_cmds(dev, tty);
+    spin_unlock_irqrestore(&dev->lock, flags);
 
-    //printk("packet : %x %x %x\n", a, b, c); 
+    if (events)
+	wake_up_interruptible(&dev->evq_wait);
 }
 
 /******** IMPORTANT NOTE: READ THIS BEFORE IMPLEMENTING THE IOCTLS ************
@@ -118,18 +489,62 @@ int
 tuxctl_ioctl (struct tty_struct* tty, struct file* file, 
 	      unsigned cmd, unsigned long arg)
 {
+    struct tuxctl_dev* dev = tuxctl_ldisc_dev(tty);
+
+    if (dev == NULL)
+	return -ENODEV;
+
+    if (_IOC_TYPE(cmd) == 'E' && _IOC_NR(cmd) - IOCTL_FIRST < IOCTL_COUNT)
+	atomic_inc(&dev->dbg.ioctls[_IOC_NR(cmd) - IOCTL_FIRST]);
+    else
+	atomic_inc(&dev->dbg.ioctls_bad);
+
     switch (cmd) {
 	case TUX_INIT:
-		tux_init(tty);
+		tux_init(dev, tty);
 		return 0;
 		break;
 	case TUX_BUTTONS:
 		if(arg == 0)
 			return -EINVAL;
-		return buttons(tty, arg);
+		return buttons(dev, arg);
+		break;
+	case TUX_READ_EVENTS:
+		if(arg == 0)
+			return -EINVAL;
+		return read_events(dev, arg);
 		break;
 	case TUX_SET_LED:
-		set_LED(tty, arg);
+		set_LED(dev, tty, arg);
+		return 0;
+		break;
+	case TUX_GET_STATS:
+		if(arg == 0)
+			return -EINVAL;
+		return get_stats(dev, arg);
+		break;
+	case TUX_SET_CLOCK:
+		return set_clock(dev, tty, arg);
+		break;
+	case TUX_SET_MOUSE:
+		return set_mouse(dev, tty, arg);
+		break;
+	case TUX_READ_MOUSE:
+		if(arg == 0)
+			return -EINVAL;
+		return read_mouse(dev, arg);
+		break;
+	case TUX_SET_ANIM:
+		if(arg == 0)
+			return -EINVAL;
+		return set_anim(dev, tty, arg);
+		break;
+	case TUX_GET_STATE_OFFSET:
+		if(arg == 0)
+			return -EINVAL;
+		if (put_user(dev->index * PAGE_SIZE,
+			     (unsigned long __user *)arg))
+			return -EFAULT;
 		return 0;
 		break;
 	default:
@@ -139,198 +554,1002 @@ tuxctl_ioctl (struct tty_struct* tty, struct file* file,
 }
 
 /*
- * tux_init(struct tty_struct* tty)
+ * tux_init(struct tuxctl_dev* dev, struct tty_struct* tty)
  * Description: Helper function used to initialize all ports, controllers, and etc. into the correct modes and usages
- * Inputs: tty - pointer to a tty_struct for use in calling the function tuxctl_ldisc_put
+ * Inputs: dev - the controller's state
+ *		   tty - pointer to a tty_struct for use in calling the function tuxctl_ldisc_put
  * Outputs: None
  * Returns: None
- * Side Effects: Opens the port to write into the TUX, sets TUX into LED User mode, turns BIOC on
+ * Side Effects: Opens the port to write into the TUX, sets TUX into LED User mode, turns BIOC on,
+ *				 blanks the LEDs; discards queued commands and
+ *				 events
  */
 
 void
-tux_init (struct tty_struct * tty)
+tux_init (struct tuxctl_dev* dev, struct tty_struct * tty)
+{
+	unsigned long flags;
+
+	stop_anim(dev);
+	spin_lock_irqsave(&dev->lock, flags);
+	dev->button_press = 0xFF; // nothing pressed (active low)
+	tuxctl_evq_init(&dev->evq);
+	dev->led_save = CLEARIT;
+	dev->led_valid = 0;
+	dev->clock_on = 0;
+	dev->mouse_on = 0;
+	memset(&dev->mouse, 0, sizeof(dev->mouse));
+	publish_state(dev);
+	restart_device(dev, tty);
+	spin_unlock_irqrestore(&dev->lock, flags);
+	return;
+}
+
+/*
+ * restart_device(struct tuxctl_dev* dev, struct tty_struct* tty)
+ * Description: Throws away the pipeline's queued commands (the device has
+ * just been reset, or is being initialized) and queues the commands that
+ * put it into LED user mode with button interrupts on, followed by the
+ * last LED value set (or a blank display if none has been), or the
+ * current frame of an animation, which goes on playing. In clock mode,
+ * the clock is set to the time it should show and started instead.
+ * Mouse mode is turned back on if it was on.
+ * Call with the device lock held.
+ * Inputs: dev - the controller's state
+ *		   tty - pointer to a tty_struct
+ * Outputs: None
+ * Returns: None
+ * Side Effects: Starts sending the commands
+ */
+void restart_device(struct tuxctl_dev* dev, struct tty_struct* tty)
 {
 	unsigned char buf[2];
-	spin_lock_init (&lock);
 
-	button_press = 0x00;
-	led_save = CLEARIT;
+	dev->cmd_head = dev->cmd_tail;
+	dev->cmd_in_flight = 0;
+	dev->led_pending = 0;
+
+	if (dev->mouse_on) {
+		buf[0] = MTCP_MOUSE_ON;
+		queue_cmd(dev, buf, 1, 0);
+	}
 
+	if (dev->clock_on) {
+		buf[0] = MTCP_BIOC_ON;
+		queue_cmd(dev, buf, 1, 1);
+		queue_clock(dev);
+		send_cmds(dev, tty);
+		return;
+	}
 	buf[0] = MTCP_LED_USR;
 	buf[1] = MTCP_BIOC_ON;
-	tuxctl_ldisc_put(tty, buf, 2);
+	queue_cmd(dev, buf, 2, 1);
+	if (dev->anim_on)
+		led_packet(dev->anim.frame[dev->anim_frame].led, dev->led_buf);
+	else if (dev->led_valid)
+		led_packet(dev->led_save, dev->led_buf);
+	else
+		clear_LED(dev);
+	dev->led_pending = 1;
+	send_cmds(dev, tty);
+}
 
-	clear_LED(tty);
-	return;
+/*
+ * queue_cmd(struct tuxctl_dev* dev, const unsigned char* buf, int len,
+ *			 int ack)
+ * Description: Adds a command to the pipeline's queue. Call with the
+ * device lock held, then call send_cmds.
+ * Inputs: dev - the controller's state
+ *		   buf - the command bytes
+ *		   len - number of bytes (at most CMD_MAX_LEN)
+ *		   ack - non-zero if the controller answers with MTCP_ACK
+ * Outputs: None
+ * Returns: None
+ * Side Effects: Drops (and counts) the command if the queue is full
+ */
+void queue_cmd(struct tuxctl_dev* dev, const unsigned char* buf, int len,
+	       int ack)
+{
+	struct tux_cmd* c;
+	unsigned int depth;
+
+	if (dev->cmd_tail - dev->cmd_head == CMD_Q_LEN) {
+		dev->stats.cmds_dropped++;
+		return;
+	}
+	c = &dev->cmd_q[dev->cmd_tail % CMD_Q_LEN];
+	memcpy(c->buf, buf, len);
+	c->len = len;
+	c->ack = (ack != 0);
+	dev->cmd_tail++;
+	depth = dev->cmd_tail - dev->cmd_head + dev->led_pending;
+	if (dev->stats.max_queue_depth < depth)
+		dev->stats.max_queue_depth = depth;
+}
+
+/*
+ * send_cmds(struct tuxctl_dev* dev, struct tty_struct* tty)
+ * Description: Sends queued commands, oldest first and then any pending
+ * LED update, until one that is answered with MTCP_ACK is on the line. 
+ * Does nothing while such a command is in flight, unless its ACK is
+ * overdue. Arms ack_timer to run again when the ACK is due, or at the
+ * next tick if the transmit buffer is full. Call with the device lock
+ * held.
+ * Inputs: dev - the controller's state
+ *		   tty - pointer to a tty_struct
+ * Outputs: None
+ * Returns: None
+ * Side Effects: Writes to the line discipline; a command that doesn't fit
+ *				 in its transmit buffer is left queued for the
+ *				 next call
+ */
+void send_cmds(struct tuxctl_dev* dev, struct tty_struct* tty)
+{
+	struct tux_cmd* c;
+
+	if (dev->cmd_in_flight) {
+		if (time_before(jiffies, dev->cmd_sent_at + ACK_TIMEOUT))
+			return;
+		dev->cmd_in_flight = 0;
+		dev->stats.ack_timeouts++;
+	}
+	while (!dev->cmd_in_flight) {
+		if (dev->cmd_head != dev->cmd_tail) {
+			c = &dev->cmd_q[dev->cmd_head % CMD_Q_LEN];
+			if (0 != tuxctl_ldisc_put(tty, c->buf, c->len)) {
+				dev->stats.tx_full++;
+				dev->tx_blocked = 1;
+				mod_timer(&dev->ack_timer, jiffies + 1);
+				return;
+			}
+			dev->tx_blocked = 0;
+			dev->cmd_head++;
+			dev->stats.cmds_sent++;
+			trace_tuxctl_cmd_tx(dev->index, c->buf, c->len, c->ack);
+			if (!c->ack)
+				continue;
+		} else if (dev->led_pending) {
+			if (0 != tuxctl_ldisc_put(tty, dev->led_buf,
+						  CMD_MAX_LEN)) {
+				dev->stats.tx_full++;
+				dev->tx_blocked = 1;
+				mod_timer(&dev->ack_timer, jiffies + 1);
+				return;
+			}
+			dev->tx_blocked = 0;
+			dev->led_pending = 0;
+			dev->stats.led_sent++;
+			dev->stats.cmds_sent++;
+			trace_tuxctl_cmd_tx(dev->index, dev->led_buf,
+					    CMD_MAX_LEN, 1);
+		} else {
+			return;
+		}
+		dev->cmd_in_flight = 1;
+		dev->cmd_sent_at = jiffies;
+		dev->dbg.cmd_sent = ktime_to_ns(ktime_get());
+		mod_timer(&dev->ack_timer, dev->cmd_sent_at + ACK_TIMEOUT);
+	}
+}
+
+/*
+ * ack_tick(unsigned long data)
+ * Description: ack_timer's callback: runs send_cmds, which gives up on an
+ * overdue ACK or retries a command that didn't fit in the transmit
+ * buffer, so the pipeline never waits on an event that won't come. Runs
+ * in interrupt context.
+ * Inputs: data - the controller's state
+ * Outputs: None
+ * Returns: None
+ * Side Effects: Sends commands
+ */
+static void ack_tick(unsigned long data)
+{
+	struct tuxctl_dev* dev = (struct tuxctl_dev*)data;
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	send_cmds(dev, dev->tty);
+	/* tuxctl_dev_tx_ready may have moved the timer ahead of the ACK
+	 * deadline */
+	if (dev->cmd_in_flight)
+		mod_timer(&dev->ack_timer, dev->cmd_sent_at + ACK_TIMEOUT);
+	spin_unlock_irqrestore(&dev->lock, flags);
+}
+
+/*
+ * tuxctl_dev_tx_ready(struct tuxctl_dev* dev)
+ * Description: Called by the line discipline when the serial driver can
+ * take more: if a command didn't fit in the transmit buffer, retries it
+ * at once from ack_timer. The device lock may be held by the caller (the
+ * transmit path runs under it), so it isn't taken here.
+ * Inputs: dev - the controller's state
+ * Outputs: None
+ * Returns: None
+ * Side Effects: None
+ */
+void tuxctl_dev_tx_ready(struct tuxctl_dev* dev)
+{
+	if (dev->tx_blocked)
+		mod_timer(&dev->ack_timer, jiffies);
 }
 
 /*
  * reset
  * Description: restores interrupt enabling and led setting along with previous led values
- * after MTCP_RESET interrupt occurs.
- * Inputs: tty - pointer to a tty_struct
+ * after MTCP_RESET interrupt occurs. Call with the device lock held.
+ * Inputs: dev - the controller's state
+ *		   tty - pointer to a tty_struct
  * Outputs: None
  * Returns: None
  * Side Effects: Restores leds and button usage on the TUX controller
  */
-void reset(struct tty_struct* tty)
+void reset(struct tuxctl_dev* dev, struct tty_struct* tty)
 {
-	char reset_buffer_array[2];
-	spin_lock(&lock);
 	/* reinitialize the TUX so it's usable */
-	reset_buffer_array[0] = MTCP_LED_USR;
-	reset_buffer_array[1] = MTCP_BIOC_ON;
-
-	reset_flag = 1;
-	tuxctl_ldisc_put(tty, reset_buffer_array, 2);
-	spin_unlock(&lock);
+	restart_device(dev, tty);
 }
 
 /*
- * handle_bioc(unsigned char b, unsigned char c)
+ * handle_bioc(struct tuxctl_dev* dev, unsigned char b, unsigned char c,
+ *			   unsigned long long now)
  * Description: When the interrupt MTCP_BIOC_EVENT comes in from the TUX, 
  * this function parses the data into a usable format to return to user.
- * Inputs: b - byte 1 from packet that's received
+ * Call with the device lock held.
+ * Inputs: dev - the controller's state
+ *		   b - byte 1 from packet that's received
  *		   c - byte 2 from packet that's received
+ *		   now - time the packet arrived, in ns
  * Outputs: None
  * Returns:	None
- * Side Effects: populates button buffer to be populated into user space
+ * Side Effects: populates button buffer to be populated into user space;
+ *				 queues a timestamped event (the caller wakes up
+ *				 pollers); updates the state page
  */
 
-void handle_bioc (unsigned char b, unsigned char c)
+void handle_bioc (struct tuxctl_dev* dev, unsigned char b, unsigned char c,
+		  unsigned long long now)
 {
 	unsigned char bit_mask = 0x0F;
-	spin_lock(&lock);
 
 	b &= bit_mask;	//mask high 4 bits
 	c &= bit_mask; // mask low 4 bits
 	c = c << 4;    //shift packet c to MSB
 
-	button_press = b | c; //combine b and c packets into 1
-	spin_unlock(&lock);
+	dev->button_press = b | c; //combine b and c packets into 1
+	dev->button_time = now;
+	tuxctl_evq_push(&dev->evq, b | c, now);
+	publish_state(dev);
+}
+
+/*
+ * handle_mouse(struct tuxctl_dev* dev, const unsigned char* packet)
+ * Description: Adds the movement in a mouse packet (see MTCP_IS_MOUSE in
+ * mtcp.h) to the movement waiting for TUX_READ_MOUSE. Each of X and Y is
+ * a 7-bit value in bytes 1 and 2 with its sign bit in byte 0. Call with
+ * the device lock held.
+ * Inputs: dev - the controller's state
+ *		   packet - the 3-byte packet
+ * Outputs: None
+ * Returns:	None
+ * Side Effects: updates the state page (the caller wakes up pollers)
+ */
+void handle_mouse(struct tuxctl_dev* dev, const unsigned char* packet)
+{
+	int dx = packet[1] & 0x7F;
+	int dy = packet[2] & 0x7F;
+
+	if (packet[0] & MOUSE_XS)
+		dx -= 0x80;
+	if (packet[0] & MOUSE_YS)
+		dy -= 0x80;
+	dev->mouse.dx += dx;
+	dev->mouse.dy += dy;
+	dev->mouse.buttons = packet[0] & (MOUSE_LEFT | MOUSE_RIGHT |
+					  MOUSE_MIDDLE);
+	dev->mouse.packets++;
+	publish_state(dev);
+}
+
+/*
+ * set_mouse(struct tuxctl_dev* dev, struct tty_struct* tty, unsigned long arg)
+ * Description: Turns mouse mode on or off (TUX_SET_MOUSE).
+ * Inputs:	dev - the controller's state
+ *			tty - pointer to a tty_struct
+ *			arg - non-zero for mouse mode
+ * Outputs: None
+ * Returns:	0
+ * Side Effects: Queues the command
+ */
+int set_mouse(struct tuxctl_dev* dev, struct tty_struct* tty, unsigned long arg)
+{
+	unsigned char buf[1];
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	dev->mouse_on = (arg != 0);
+	buf[0] = dev->mouse_on ? MTCP_MOUSE_ON : MTCP_MOUSE_OFF;
+	queue_cmd(dev, buf, 1, 0);
+	send_cmds(dev, tty);
+	spin_unlock_irqrestore(&dev->lock, flags);
+	return 0;
+}
+
+/*
+ * read_mouse(struct tuxctl_dev* dev, unsigned long arg)
+ * Description: Copies the mouse movement received since the last call into
+ * user space, and clears it (TUX_READ_MOUSE).
+ * Inputs:	dev - the controller's state
+ *			arg - pointer to a struct tux_mouse in user space
+ * Outputs: None
+ * Returns:	0 on success, -EFAULT if user space can't be accessed (the
+ *			movement is then lost)
+ * Side Effects: None
+ */
+int read_mouse(struct tuxctl_dev* dev, unsigned long arg)
+{
+	struct tux_mouse copy;
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	copy = dev->mouse;
+	dev->mouse.dx = 0;
+	dev->mouse.dy = 0;
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	if (copy_to_user((void __user *)arg, &copy, sizeof(copy)))
+		return -EFAULT;
+	return 0;
 }
 
 /*
- * buttons(struct tty_struct*, unsigned long arg)
+ * buttons(struct tuxctl_dev* dev, unsigned long arg)
  * Description: Copies the correctly parsed button arg into userspace.
- * Inputs:	tty - pointer to a tty_struct
+ * Inputs:	dev - the controller's state
  * 			arg - pointer to an integer in user space
  * Outputs: None
  * Returns:	Returns 0 upon successful copy, -EINVAL on unsuccessful copy
  * Side Effects: Writes into user space and ideally controls movement of player
  */
 
-int buttons(struct tty_struct* tty, unsigned long arg)
+int buttons(struct tuxctl_dev* dev, unsigned long arg)
 {
 	
 	int* user = (int*)arg;
-	int valid;
-	spin_lock(&lock);
-	valid = copy_to_user(user, &button_press, 1);
-	spin_unlock(&lock);
-	if (valid != 0)
+	unsigned char button_press;
+	unsigned long flags;
+
+	/* copy_to_user may sleep, so never call it with the lock held */
+	spin_lock_irqsave(&dev->lock, flags);
+	button_press = dev->button_press;
+	spin_unlock_irqrestore(&dev->lock, flags);
+	if (copy_to_user(user, &button_press, 1) != 0)
 		return -EINVAL;
 	return 0;	
 }
 
 /*
- * set_LED(struct tty_struct* tty, unsigned long arg)
- * Description: Copies to user space the correctly parsed button argument.
+ * read_events(struct tuxctl_dev* dev, unsigned long arg)
+ * Description: Moves up to the requested number of queued button events
+ * into user space (TUX_READ_EVENTS). Never waits for events.
+ * Inputs:	dev - the controller's state
+ * 			arg - pointer to a struct tux_event_batch in user space,
+ *				  whose count gives the most events wanted
+ * Outputs: None
+ * Returns:	0 on success, -EFAULT if user space can't be accessed
+ * Side Effects: removes the events returned from the queue
+ */
+
+int read_events(struct tuxctl_dev* dev, unsigned long arg)
+{
+	struct tux_event_batch __user *user = (void __user *)arg;
+	struct tux_event_batch batch;
+	unsigned long flags;
+	unsigned int max;
+
+	if (get_user(max, &user->count))
+		return -EFAULT;
+	if (max > TUX_EVENT_BATCH)
+		max = TUX_EVENT_BATCH;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	batch.count = tuxctl_evq_pop(&dev->evq, batch.ev, max, &batch.lost);
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	if (copy_to_user(user, &batch, offsetof(struct tux_event_batch, ev) +
+			 batch.count * sizeof(batch.ev[0])))
+		return -EFAULT;
+	return 0;
+}
+
+/*
+ * tuxctl_poll(struct tty_struct*, struct file*, struct poll_table_struct*)
+ * Description: poll/select support for the line discipline: the tty is
+ * readable while button events are queued or mouse movement is waiting.
  * Inputs:	tty - pointer to a tty_struct
- * 			arg - pointer to an integer in user space
+ * 			file - the file being polled
+ * 			wait - poll table to register our wait queue in
  * Outputs: None
- * Returns:	int
+ * Returns:	POLLIN | POLLRDNORM if events are queued, 0 if not (POLLERR
+ *			if the line discipline has no state for the tty)
+ * Side Effects: None
+ */
+
+unsigned int tuxctl_poll(struct tty_struct* tty, struct file* file,
+			 struct poll_table_struct* wait)
+{
+	struct tuxctl_dev* dev = tuxctl_ldisc_dev(tty);
+	unsigned long flags;
+	unsigned int mask = 0;
+
+	if (dev == NULL)
+		return POLLERR;
+
+	poll_wait(file, &dev->evq_wait, wait);
+	spin_lock_irqsave(&dev->lock, flags);
+	if (!tuxctl_evq_empty(&dev->evq) || dev->mouse.dx != 0 ||
+	    dev->mouse.dy != 0)
+		mask = POLLIN | POLLRDNORM;
+	spin_unlock_irqrestore(&dev->lock, flags);
+	return mask;
+}
+
+/*
+ * set_LED(struct tuxctl_dev* dev, struct tty_struct* tty, unsigned long arg)
+ * Description: Queues an LED update (TUX_SET_LED). An update identical to
+ * the last one is skipped, and an update that has not been sent yet is
+ * replaced by the new one, so only the newest value goes out. In clock
+ * mode or during an animation the value is only saved.
+ * Inputs:	dev - the controller's state
+ *			tty - pointer to a tty_struct
+ * 			arg - the LED value: digits in the low 16 bits, which
+ *				  LEDs are on in bits 16-19, decimal points in
+ *				  bits 24-27
+ * Outputs: None
+ * Returns:	0
  * Side Effects: Set's the LED's to the values that need to be displayed. Ideally, the time.
  */
- int set_LED(struct tty_struct* tty, unsigned long arg)
+ int set_LED(struct tuxctl_dev* dev, struct tty_struct* tty, unsigned long arg)
  {
- 	/* variable declartions */
- 	unsigned int num_seconds = (unsigned int)arg;
-	unsigned int data = num_seconds;
-	unsigned int leds = num_seconds >> 16;
-	unsigned int dec = num_seconds >> 24;
-	// fourth digit is left most digit
-	unsigned char digits[4];
-	unsigned char seven_segment[4];
-	unsigned char led_array[4];
-	unsigned char decimals[4];
-	unsigned char led_buf[6];
-	int i;
-	int index = 2;
-		/* lock while setting the global variable led_save */
-		spin_lock(&lock);
- 		led_save = num_seconds;
- 		spin_unlock(&lock);
-
- 		clear_LED(tty);
-
- 		data &= 0x0000FFFF;
-
- 		/* look at each byte by using masks and shifting*/
- 		digits[0] = data & 0x000F;
- 		digits[1] = (data & 0x00F0) >> 4;
- 		digits[2] = (data & 0x0F00) >> 8;
- 		digits[3] = data >> 12;
- 		/* fill the seven segment display with the appropriate hex */
- 		seven_segment[0] = hex_led[digits[0]];
- 		seven_segment[1] = hex_led[digits[1]];
- 		seven_segment[2] = hex_led[digits[2]];
- 		seven_segment[3] = hex_led[digits[3]];
- 		/* look at the first byte in leds */
- 		leds &= 0x000F;
- 		/* fill the led_array with the appropriate bit */
- 		led_array[0] = leds & 0x1;
- 		led_array[1] = (leds & 0x2) >> 1;
- 		led_array[2] = (leds & 0x4) >> 2;
- 		led_array[3] = leds >> 3;
- 		/* mask the decimal point */
- 		dec &= 0x0F;
- 		/* look at each bit of the decimals */
- 		decimals[0] = dec & 0x1;
- 		decimals[1] = (dec & 0x2) >> 1;
- 		decimals[2] = (dec & 0x4) >> 2;
- 		decimals[3] = dec >> 3;
-
- 		/*shift the high bit to make it the MSB */
- 		seven_segment[0] |= (decimals[0] << 4);
- 		seven_segment[1] |= (decimals[1] << 4);
- 		seven_segment[2] |= (decimals[2] << 4);
- 		seven_segment[3] |= (decimals[3] << 4);
-
- 		led_buf[0] = MTCP_LED_SET;
- 		led_buf[1] = leds;
-
- 		for(i = 0; i < 4; i++)
- 		{
- 			if (led_array[i] == 1)
- 			{
- 				led_buf[index] = seven_segment[i];
- 				index++;
- 			}
- 		}
- 		tuxctl_ldisc_put(tty, led_buf, index);
- 	return 0;
+	unsigned long flags;
+	unsigned int depth;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	dev->stats.led_requests++;
+	if (dev->led_valid && dev->led_save == (unsigned int)arg) {
+		dev->stats.led_skipped++;
+	} else if (dev->clock_on || dev->anim_on) {
+		/* kept for when the clock or animation is done */
+		dev->led_save = arg;
+		dev->led_valid = 1;
+		publish_state(dev);
+		dev->stats.led_skipped++;
+	} else {
+		dev->led_save = arg;
+		dev->led_valid = 1;
+		publish_state(dev);
+		if (dev->led_pending)
+			dev->stats.led_coalesced++;
+		led_packet(arg, dev->led_buf);
+		dev->led_pending = 1;
+		depth = dev->cmd_tail - dev->cmd_head + 1;
+		if (dev->stats.max_queue_depth < depth)
+			dev->stats.max_queue_depth = depth;
+		send_cmds(dev, tty);
+	}
+	spin_unlock_irqrestore(&dev->lock, flags);
+	return 0;
  }
 
- /*
- * clear_LED(struct tty_struct*)
- * Description: this helper clears the led by sending a buffer with all values back to
- * when they were first initialized
- * Inputs:	tty - pointer to a tty_struct
+/*
+ * set_clock(struct tuxctl_dev* dev, struct tty_struct* tty, unsigned long arg)
+ * Description: Hands the LED display to the controller's clock, started
+ * at arg seconds, or (for TUX_CLOCK_OFF) stops the clock and shows the
+ * last LED value again (TUX_SET_CLOCK).
+ * Inputs:	dev - the controller's state
+ *			tty - pointer to a tty_struct
+ *			arg - seconds to start counting up from, or
+ *				  TUX_CLOCK_OFF
+ * Outputs: None
+ * Returns:	0 on success, -EINVAL if arg is out of range
+ * Side Effects: Queues the commands; a pending LED update (or a playing
+ *				 animation) is dropped when the clock takes over
+ */
+int set_clock(struct tuxctl_dev* dev, struct tty_struct* tty, unsigned long arg)
+{
+	unsigned char buf[2];
+	unsigned long flags;
+
+	if (arg != TUX_CLOCK_OFF && arg > TUX_CLOCK_MAX)
+		return -EINVAL;
+
+	if (arg != TUX_CLOCK_OFF)
+		stop_anim(dev);
+	spin_lock_irqsave(&dev->lock, flags);
+	if (arg != TUX_CLOCK_OFF) {
+		dev->clock_on = 1;
+		dev->clock_base = arg;
+		dev->clock_start = jiffies;
+		dev->led_pending = 0;
+		queue_clock(dev);
+		send_cmds(dev, tty);
+	} else if (dev->clock_on) {
+		dev->clock_on = 0;
+		buf[0] = MTCP_CLK_STOP;
+		buf[1] = MTCP_LED_USR;
+		queue_cmd(dev, buf, 2, 0);
+		if (dev->led_valid)
+			led_packet(dev->led_save, dev->led_buf);
+		else
+			clear_LED(dev);
+		dev->led_pending = 1;
+		send_cmds(dev, tty);
+	}
+	spin_unlock_irqrestore(&dev->lock, flags);
+	return 0;
+}
+
+/*
+ * set_anim(struct tuxctl_dev* dev, struct tty_struct* tty, unsigned long arg)
+ * Description: Starts playing an animation on the LEDs, replacing any
+ * animation or clock shown, or stops the animation if it has no frames
+ * (TUX_SET_ANIM). Frame 0 is queued at once and anim_tick shows the rest.
+ * Inputs:	dev - the controller's state
+ *			tty - pointer to a tty_struct
+ *			arg - pointer to a struct tux_anim in user space
+ * Outputs: None
+ * Returns:	0 on success, -EFAULT if user space can't be accessed, -EINVAL
+ *			for too many frames or a frame that is too short
+ * Side Effects: Queues commands; starts anim_timer
+ */
+int set_anim(struct tuxctl_dev* dev, struct tty_struct* tty, unsigned long arg)
+{
+	struct tux_anim anim;
+	unsigned char buf[2];
+	unsigned long flags;
+	unsigned int i;
+
+	if (copy_from_user(&anim, (void __user *)arg, sizeof(anim)))
+		return -EFAULT;
+	if (anim.n_frames > TUX_ANIM_FRAMES)
+		return -EINVAL;
+	for (i = 0; i < anim.n_frames; i++)
+		if (anim.frame[i].ms < TUX_ANIM_MIN_MS)
+			return -EINVAL;
+
+	stop_anim(dev);
+	if (anim.n_frames == 0)
+		return 0;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	if (dev->clock_on) {
+		dev->clock_on = 0;
+		buf[0] = MTCP_CLK_STOP;
+		buf[1] = MTCP_LED_USR;
+		queue_cmd(dev, buf, 2, 0);
+	}
+	dev->anim = anim;
+	dev->anim_frame = 0;
+	dev->anim_left = anim.repeat - 1;
+	dev->anim_on = 1;
+	if (dev->led_pending)
+		dev->stats.led_coalesced++;
+	led_packet(anim.frame[0].led, dev->led_buf);
+	dev->led_pending = 1;
+	dev->stats.anim_frames++;
+	send_cmds(dev, tty);
+	hrtimer_start(&dev->anim_timer,
+		      anim_interval(anim.frame[0].ms),
+		      HRTIMER_MODE_REL);
+	spin_unlock_irqrestore(&dev->lock, flags);
+	return 0;
+}
+
+/*
+ * stop_anim(struct tuxctl_dev* dev)
+ * Description: Stops the animation, if one is playing, and queues the last
+ * LED value set. Call without the device lock held: this waits for
+ * anim_tick to finish if it is running, and anim_tick takes the lock.
+ * Inputs:	dev - the controller's state
+ * Outputs: None
+ * Returns:	None
+ * Side Effects: Queues commands
+ */
+void stop_anim(struct tuxctl_dev* dev)
+{
+	unsigned long flags;
+
+	hrtimer_cancel(&dev->anim_timer);
+	spin_lock_irqsave(&dev->lock, flags);
+	if (dev->anim_on) {
+		dev->anim_on = 0;
+		if (dev->led_valid)
+			led_packet(dev->led_save, dev->led_buf);
+		else
+			clear_LED(dev);
+		dev->led_pending = 1;
+		send_cmds(dev, dev->tty);
+	}
+	spin_unlock_irqrestore(&dev->lock, flags);
+}
+
+/*
+ * anim_tick(struct hrtimer* timer)
+ * Description: anim_timer's callback: moves the animation on to its next
+ * frame and queues it, or, at the end of the last play, shows the last
+ * LED value set again. A frame still waiting to be sent is replaced, so
+ * the serial line never falls behind. The timer is moved on by the
+ * frame's duration from when it was due, so frame times don't drift.
+ * Runs in interrupt context.
+ * Inputs:	timer - the device's anim_timer
+ * Outputs: None
+ * Returns:	HRTIMER_RESTART while the animation goes on
+ * Side Effects: Queues commands
+ */
+static enum hrtimer_restart anim_tick(struct hrtimer* timer)
+{
+	struct tuxctl_dev* dev = container_of(timer, struct tuxctl_dev,
+					      anim_timer);
+	enum hrtimer_restart ret = HRTIMER_RESTART;
+	unsigned long led;
+	unsigned int ms; // how long the next frame is shown
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	if (!dev->anim_on) {
+		spin_unlock_irqrestore(&dev->lock, flags);
+		return HRTIMER_NORESTART;
+	}
+	if (++dev->anim_frame == dev->anim.n_frames) {
+		dev->anim_frame = 0;
+		if (dev->anim.repeat != 0 && dev->anim_left-- == 0) {
+			dev->anim_on = 0;
+			ret = HRTIMER_NORESTART;
+		}
+	}
+	if (dev->anim_on) {
+		led = dev->anim.frame[dev->anim_frame].led;
+		ms = dev->anim.frame[dev->anim_frame].ms;
+		dev->stats.anim_frames++;
+		hrtimer_forward(timer, ktime_get(), anim_interval(ms));
+	} else if (dev->led_valid) {
+		led = dev->led_save;
+	} else {
+		led = 0; // all LEDs off
+	}
+	if (dev->led_pending)
+		dev->stats.led_coalesced++;
+	led_packet(led, dev->led_buf);
+	dev->led_pending = 1;
+	send_cmds(dev, dev->tty);
+	spin_unlock_irqrestore(&dev->lock, flags);
+	return ret;
+}
+
+/*
+ * queue_clock(struct tuxctl_dev* dev)
+ * Description: Queues the commands that set the controller's clock to the
+ * time it should now show (clock_base plus the time since clock_start),
+ * start it counting up, and show it on the LEDs. Call with the device
+ * lock held, then call send_cmds.
+ * Inputs:	dev - the controller's state
+ * Outputs: None
+ * Returns:	None
+ * Side Effects: None
+ */
+void queue_clock(struct tuxctl_dev* dev)
+{
+	unsigned char buf[CMD_MAX_LEN];
+	unsigned long secs;
+
+	secs = dev->clock_base + (jiffies - dev->clock_start) / HZ;
+	if (secs > TUX_CLOCK_MAX)
+		secs = TUX_CLOCK_MAX;
+
+	/* the clock commands get no answer, so they need no ACK */
+	buf[0] = MTCP_CLK_RESET;
+	buf[1] = MTCP_CLK_UP;
+	buf[2] = MTCP_CLK_MAX;
+	buf[3] = TUX_CLOCK_MAX / 60;
+	buf[4] = TUX_CLOCK_MAX % 60;
+	queue_cmd(dev, buf, 5, 0);
+	buf[0] = MTCP_CLK_SET;
+	buf[1] = secs / 60;
+	buf[2] = secs % 60;
+	buf[3] = MTCP_CLK_RUN;
+	buf[4] = MTCP_LED_CLK;
+	queue_cmd(dev, buf, 5, 0);
+}
+
+/*
+ * led_packet(unsigned long arg, unsigned char* buf)
+ * Description: Builds the MTCP_LED_SET packet for an LED value. All four
+ * LEDs are set, with those that are off left blank, so the one packet
+ * replaces anything shown before.
+ * Inputs:	arg - the LED value, as for set_LED
+ * Outputs: buf - the CMD_MAX_LEN-byte packet
+ * Returns:	None
+ * Side Effects: None
+ */
+void led_packet(unsigned long arg, unsigned char* buf)
+{
+	unsigned int data = arg & 0xFFFF;
+	unsigned int leds = (arg >> 16) & 0x0F;
+	unsigned int dec = (arg >> 24) & 0x0F;
+	int i;
+
+	buf[0] = MTCP_LED_SET;
+	buf[1] = 0x0F;
+	/* one byte per LED, rightmost first; the decimal point is bit 4 */
+	for (i = 0; i < 4; i++) {
+		if (leds & (1 << i))
+			buf[2 + i] = hex_led[(data >> (4 * i)) & 0x0F] |
+				     (((dec >> i) & 0x1) << 4);
+		else
+			buf[2 + i] = 0x00;
+	}
+}
+
+/*
+ * clear_LED(struct tuxctl_dev*)
+ * Description: this helper makes the pending LED update a blank display.
+ * Call with the device lock held.
+ * Inputs:	dev - the controller's state
+ * Outputs: None
+ * Returns: None
+ * Side Effects: replaces led_buf
+ */
+void clear_LED(struct tuxctl_dev* dev) {
+	dev->led_buf[0] = MTCP_LED_SET;
+	dev->led_buf[1] = 0x0F;
+	dev->led_buf[2] = 0x00;
+	dev->led_buf[3] = 0x00;
+	dev->led_buf[4] = 0x00;
+	dev->led_buf[5] = 0x00;
+}
+
+/*
+ * get_stats(struct tuxctl_dev* dev, unsigned long arg)
+ * Description: Copies the command pipeline counters into user space
+ * (TUX_GET_STATS), with the current queue depth and the line discipline's
+ * counters.
+ * Inputs:	dev - the controller's state
+ *			arg - pointer to a struct tux_stats in user space
+ * Outputs: None
+ * Returns:	0 on success, -EFAULT if user space can't be accessed
+ * Side Effects: None
+ */
+int get_stats(struct tuxctl_dev* dev, unsigned long arg)
+{
+	struct tux_stats copy;
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	dev->stats.queue_depth = dev->cmd_tail - dev->cmd_head +
+				 dev->led_pending;
+	copy = dev->stats;
+	spin_unlock_irqrestore(&dev->lock, flags);
+	copy.tx_lost = atomic_read(&dev->tx_lost);
+
+	if (copy_to_user((void __user *)arg, &copy, sizeof(copy)))
+		return -EFAULT;
+	return 0;
+}
+
+/*
+ * tuxctl_dev_rx_stats(struct tuxctl_dev* dev, const struct tux_stats* st)
+ * Description: Saves the line discipline's receive counters (rx_*) with
+ * the rest, for TUX_GET_STATS and debugfs.
+ * Inputs:	dev - the controller's state
+ *			st - the counters
+ * Outputs: None
+ * Returns:	None
+ * Side Effects: None
+ */
+void tuxctl_dev_rx_stats(struct tuxctl_dev* dev, const struct tux_stats* st)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	dev->stats.rx_packets = st->rx_packets;
+	dev->stats.rx_framing_errors = st->rx_framing_errors;
+	dev->stats.rx_resyncs = st->rx_resyncs;
+	dev->stats.rx_overruns = st->rx_overruns;
+	spin_unlock_irqrestore(&dev->lock, flags);
+}
+
+/*
+ * tuxctl_dev_tx_lost(struct tuxctl_dev* dev, int n)
+ * Description: Counts bytes the serial driver didn't take. This is called
+ * from the transmit path, which send_cmds runs with the device lock held,
+ * so the count is atomic rather than taking the lock.
+ * Inputs:	dev - the controller's state
+ *			n - the number of bytes lost
+ * Outputs: None
+ * Returns:	None
+ * Side Effects: None
+ */
+void tuxctl_dev_tx_lost(struct tuxctl_dev* dev, int n)
+{
+	atomic_add(n, &dev->tx_lost);
+}
+
+
+/************************ Debugging Counters *************************/
+
+/*
+ * rx_type(unsigned char opcode)
+ * Description: Classifies a received packet for the debugging counters.
+ * Inputs: opcode - the packet's first byte
+ * Outputs: None
+ * Returns: an index into rx_names
+ * Side Effects: None
+ */
+int rx_type(unsigned char opcode)
+{
+	if (MTCP_IS_MOUSE(opcode))
+		return 3;
+	switch (opcode) {
+		case MTCP_ACK:		return 0;
+		case MTCP_BIOC_EVENT:	return 1;
+		case MTCP_RESET:	return 2;
+		case MTCP_CLK_EVENT:	return 4;
+		case MTCP_POLL_OK:	return 5;
+		case MTCP_ERROR:	return 6;
+		default:		return 7;
+	}
+}
+
+/*
+ * count_ack(struct tuxctl_dev* dev, unsigned long long now)
+ * Description: Adds the round trip of the command in flight, which has
+ * just been acknowledged, to the histogram. Call with the device lock
+ * held.
+ * Inputs: dev - the controller's state
+ *		   now - when the ACK arrived, in ns
  * Outputs: None
  * Returns: None
- * Side Effects: clears the led
+ * Side Effects: None
+ */
+void count_ack(struct tuxctl_dev* dev, unsigned long long now)
+{
+	unsigned long long rtt = now - dev->dbg.cmd_sent;
+	int i;
+
+	/* shifts rather than a 64-bit division, which 32-bit kernels lack */
+	for (i = 0; i < RTT_BUCKETS - 1 && rtt >= (1000000ULL << i); i++)
+		;
+	dev->dbg.rtt[i]++;
+}
+
+/*
+ * tuxctl_debug_show(struct seq_file* m, void* v)
+ * Description: Prints a controller's debugging counters, with its command
+ * pipeline and line discipline counters (its debugfs "stats" file). Rates
+ * are per second since the controller was attached. The file may be read
+ * while (or after) the controller is detached, so it holds the index of
+ * the controller in devs[] rather than a pointer to its state, and the
+ * counters are copied with devs_lock held.
+ * Inputs: m - the file, whose private data is the controller's index
+ *		   v - unused
+ * Outputs: None
+ * Returns: 0, or -ENODEV if the controller has been detached
+ * Side Effects: None
  */
-void clear_LED(struct tty_struct* tty) {
-	unsigned char clear_buf[6];
-// fill a clear buffer to display nothing on the LEDS
-	clear_buf[0] = MTCP_LED_SET;
-	clear_buf[1] = 0x0F;
-	clear_buf[2] = 0x00;
-	clear_buf[3] = 0x00;
-	clear_buf[4] = 0x00;
-	clear_buf[5] = 0x00;
+static int tuxctl_debug_show(struct seq_file* m, void* v)
+{
+	struct tuxctl_dev* dev;
+	struct tux_stats st;
+	unsigned int rx[RX_TYPES], rtt[RTT_BUCKETS], ioctls[IOCTL_COUNT];
+	unsigned int resets, bad, n;
+	unsigned long flags, secs;
+	int i;
 
-	tuxctl_ldisc_put(tty, clear_buf, 6);
+	spin_lock(&devs_lock);
+	dev = devs[(long)m->private];
+	if (dev != NULL) {
+		spin_lock_irqsave(&dev->lock, flags);
+		memcpy(rx, dev->dbg.rx, sizeof(rx));
+		memcpy(rtt, dev->dbg.rtt, sizeof(rtt));
+		resets = dev->dbg.resets;
+		st = dev->stats;
+		secs = (jiffies - dev->dbg.since) / HZ;
+		spin_unlock_irqrestore(&dev->lock, flags);
+		st.tx_lost = atomic_read(&dev->tx_lost);
+		for (i = 0; i < IOCTL_COUNT; i++)
+			ioctls[i] = atomic_read(&dev->dbg.ioctls[i]);
+		bad = atomic_read(&dev->dbg.ioctls_bad);
+	}
+	spin_unlock(&devs_lock);
+	if (dev == NULL) // don't use it: it may have been freed
+		return -ENODEV;
+	if (secs == 0)
+		secs = 1;
+
+	seq_printf(m, "seconds               %lu\n", secs);
+	seq_printf(m, "rx packets            %u\n", st.rx_packets);
+	for (i = 0; i < RX_TYPES; i++)
+		seq_printf(m, "  %-19s %u\n", rx_names[i], rx[i]);
+	seq_printf(m, "rx bytes dropped      %u\n", st.rx_overruns);
+	seq_printf(m, "rx framing errors     %u\n", st.rx_framing_errors);
+	seq_printf(m, "rx resyncs            %u\n", st.rx_resyncs);
+	seq_printf(m, "tx bytes dropped      %u\n", st.tx_lost);
+	seq_printf(m, "tx buffer full        %u\n", st.tx_full);
+	seq_printf(m, "cmds sent             %u\n", st.cmds_sent);
+	seq_printf(m, "cmds dropped          %u\n", st.cmds_dropped);
+	seq_printf(m, "ack timeouts          %u\n", st.ack_timeouts);
+	seq_printf(m, "resets                %u\n", resets);
+	seq_printf(m, "ack latency (ms)\n");
+	for (i = 0; i < RTT_BUCKETS - 1; i++)
+		seq_printf(m, "  < %-17u %u\n", 1U << i, rtt[i]);
+	seq_printf(m, "  >= %-16u %u\n", 1U << (RTT_BUCKETS - 2), rtt[i]);
+	seq_printf(m, "ioctls                calls      per second\n");
+	for (i = 0; i < IOCTL_COUNT; i++) {
+		n = ioctls[i];
+		seq_printf(m, "  %-19s %-10u %lu.%02lu\n", ioctl_names[i], n,
+			   n / secs, (n % secs) * 100 / secs);
+	}
+	n = bad;
+	seq_printf(m, "  %-19s %-10u %lu.%02lu\n", "invalid", n,
+		   n / secs, (n % secs) * 100 / secs);
+	return 0;
 }
 
+static int tuxctl_debug_open(struct inode* inode, struct file* file)
+{
+	return single_open(file, tuxctl_debug_show, inode->i_private);
+}
+
+static const struct file_operations tuxctl_debug_fops = {
+	.owner = THIS_MODULE,
+	.open = tuxctl_debug_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/*
+ * debugfs_add(struct tuxctl_dev* dev, struct tty_struct* tty)
+ * Description: Gives a newly attached controller a debugfs directory
+ * named after its tty, holding its "stats" file.
+ * Inputs: dev - the controller's state
+ *		   tty - the controller's tty
+ * Outputs: None
+ * Returns: None
+ * Side Effects: Leaves the controller without the file if debugfs is
+ *				 unavailable or out of memory; it works just the
+ *				 same
+ */
+void debugfs_add(struct tuxctl_dev* dev, struct tty_struct* tty)
+{
+	if (debugfs_root == NULL)
+		return;
+	dev->debugfs_dir = debugfs_create_dir(tty->name, debugfs_root);
+	if (dev->debugfs_dir == NULL)
+		return;
+	dev->debugfs_stats = debugfs_create_file("stats", S_IRUGO,
+						 dev->debugfs_dir,
+						 (void*)(long)dev->index,
+						 &tuxctl_debug_fops);
+}
+
+/*
+ * tuxctl_debugfs_init(), tuxctl_debugfs_exit()
+ * Description: Create and remove the driver's debugfs directory, "tuxctl".
+ * Inputs: None
+ * Outputs: None
+ * Returns: None
+ * Side Effects: Without debugfs, the counters are kept but not shown
+ */
+void tuxctl_debugfs_init(void)
+{
+	debugfs_root = debugfs_create_dir("tuxctl", NULL);
+	if (IS_ERR(debugfs_root)) // debugfs not built into the kernel
+		debugfs_root = NULL;
+}
+
+void tuxctl_debugfs_exit(void)
+{
+	debugfs_remove(debugfs_root);
+	debugfs_root = NULL;
+}
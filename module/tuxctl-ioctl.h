@@ -10,5 +10,158 @@
 #define TUX_LED_REQUEST _IO('E', 0x14)
 #define TUX_LED_ACK _IO('E', 0x15)
 
+/* A change of button state reported by the controller (MTCP_BIOC_EVENT).
+ * buttons has the same layout as the byte returned by TUX_BUTTONS (active
+ * low: right, down, left, up, c, b, a, start from bit 7 to bit 0). time_ns
+ * is the CLOCK_MONOTONIC time at which the packet arrived, and seq counts
+ * events, so a gap in seq means that events were lost.
+ */
+struct tux_event {
+	unsigned long long time_ns;
+	unsigned int seq;
+	unsigned char buttons;
+	unsigned char pad[3];
+};
+
+/* TUX_READ_EVENTS
+ * Removes up to count (at most TUX_EVENT_BATCH) of the oldest queued
+ * button events and returns them in ev[], with count set to the number
+ * returned and lost to the number of events dropped because the queue was
+ * full since the previous call. Never blocks; use poll/select on the tty
+ * to wait for events.
+ */
+#define TUX_EVENT_BATCH 16
+struct tux_event_batch {
+	unsigned int count;
+	unsigned int lost;
+	struct tux_event ev[TUX_EVENT_BATCH];
+};
+#define TUX_READ_EVENTS _IOWR('E', 0x16, struct tux_event_batch)
+
+/* TUX_GET_STATS
+ * Counters for the driver's command pipeline, which keeps one command
+ * awaiting MTCP_ACK on the line and queues the rest. LED updates are
+ * skipped if they match the last one, and an update not yet sent is
+ * replaced by a newer one (coalesced). Commands are dropped only if the
+ * queue is full; tx_full counts times the line discipline had no room
+ * (the command is retried later).
+ *
+ * The rx_ counters count what the line discipline received: whole
+ * packets, framing errors (a byte that cannot start or continue a packet,
+ * counted once per run of bad bytes), resyncs (packets found again after
+ * a framing error), and bytes dropped because the receive buffer was
+ * full. anim_frames counts frames of TUX_SET_ANIM animations shown (a
+ * frame replaced before it could be sent counts as coalesced). tx_lost
+ * counts bytes the serial driver took fewer of than offered, which are
+ * lost.
+ */
+struct tux_stats {
+	unsigned int cmds_sent;
+	unsigned int acks;
+	unsigned int ack_timeouts;
+	unsigned int cmds_dropped;
+	unsigned int tx_full;
+	unsigned int led_requests;
+	unsigned int led_sent;
+	unsigned int led_coalesced;
+	unsigned int led_skipped;
+	unsigned int queue_depth;
+	unsigned int max_queue_depth;
+	unsigned int rx_packets;
+	unsigned int rx_framing_errors;
+	unsigned int rx_resyncs;
+	unsigned int rx_overruns;
+	unsigned int anim_frames;
+	unsigned int tx_lost;
+};
+#define TUX_GET_STATS _IOR('E', 0x17, struct tux_stats)
+
+/* The state page
+ * The driver keeps the current state of each controller in a page that
+ * user space can map read-only, so polling the controller needs no
+ * system call: open TUX_STATE_DEVICE and mmap one page of it, read-only
+ * and shared, at the offset returned by TUX_GET_STATE_OFFSET on the
+ * controller's tty. The page starts with a struct tux_state.
+ *
+ * The state is protected by a sequence lock: the driver makes seq odd
+ * before changing the other fields and even again afterwards, so a
+ * reader copies the fields between two reads of seq (with read barriers
+ * in between) and tries again if seq was odd or changed. The fields are:
+ * buttons, as returned by TUX_BUTTONS; event_seq, the sequence number
+ * that the next event queued for TUX_READ_EVENTS will have (so events
+ * are waiting if it differs from one past the last event read); time_ns,
+ * when buttons last changed; led, the last value set with TUX_SET_LED;
+ * and mouse_packets, as returned by TUX_READ_MOUSE (so movement is
+ * waiting if it differs from the last value read).
+ */
+#define TUX_STATE_DEVICE "/dev/tuxctl"
+struct tux_state {
+	unsigned int seq;
+	unsigned int event_seq;
+	unsigned int buttons;
+	unsigned int led;
+	unsigned long long time_ns;
+	unsigned int mouse_packets;
+	unsigned int pad;
+};
+#define TUX_GET_STATE_OFFSET _IOR('E', 0x18, unsigned long)
+
+/* TUX_SET_CLOCK
+ * Hands the LED display to the controller's own clock, which then counts
+ * up once a second from arg seconds (at most TUX_CLOCK_MAX), showing
+ * minutes and seconds, with no further traffic on the serial line (the
+ * driver only sets the clock again if the controller resets). An arg of
+ * TUX_CLOCK_OFF stops the clock and shows the last TUX_SET_LED value
+ * again; values set while the clock is shown are kept but not sent.
+ */
+#define TUX_CLOCK_MAX (99 * 60 + 59)
+#define TUX_CLOCK_OFF (~0UL)
+#define TUX_SET_CLOCK _IOR('E', 0x19, unsigned long)
+
+/* TUX_SET_ANIM
+ * Plays an animation on the LEDs: each of the n_frames frames shows led
+ * (a value as for TUX_SET_LED) for ms milliseconds (at least
+ * TUX_ANIM_MIN_MS), and the sequence is played repeat times, or until
+ * replaced if repeat is 0. The driver plays it from a kernel timer, so
+ * one call does it all; frames are sent as fast as the controller
+ * acknowledges them, a frame not yet sent when the next is due being
+ * replaced by it. Afterwards the last TUX_SET_LED value is shown again
+ * (values set meanwhile are kept but not sent). An n_frames of 0 stops
+ * the animation, and TUX_SET_CLOCK replaces it. A controller reset does
+ * not interrupt it.
+ */
+#define TUX_ANIM_FRAMES 32
+#define TUX_ANIM_MIN_MS 10
+struct tux_anim_frame {
+	unsigned int led;
+	unsigned int ms;
+};
+struct tux_anim {
+	unsigned int n_frames;
+	unsigned int repeat;
+	struct tux_anim_frame frame[TUX_ANIM_FRAMES];
+};
+#define TUX_SET_ANIM _IOW('E', 0x1A, struct tux_anim)
+
+/* TUX_SET_MOUSE, TUX_READ_MOUSE
+ * TUX_SET_MOUSE puts the controller into mouse mode (MTCP_MOUSE_ON) if
+ * arg is non-zero, and takes it out if arg is zero; mouse mode is
+ * restored if the controller resets. In mouse mode the controller sends
+ * PS/2-style movement packets, whose movement the driver adds up until
+ * TUX_READ_MOUSE returns it: dx is to the right and dy is upward, both
+ * in mouse counts, and both are then cleared. buttons holds the mouse
+ * buttons last reported (MOUSE_LEFT, MOUSE_RIGHT and MOUSE_MIDDLE in
+ * mtcp.h, 1 when down), and packets counts movement packets received
+ * since TUX_INIT. The tty polls readable while movement is waiting.
+ */
+struct tux_mouse {
+	int dx;
+	int dy;
+	unsigned int buttons;
+	unsigned int packets;
+};
+#define TUX_SET_MOUSE _IOR('E', 0x1B, unsigned long)
+#define TUX_READ_MOUSE _IOR('E', 0x1C, struct tux_mouse)
+
 #endif
 
@@ -14,16 +14,19 @@
 
 #include <linux/init.h>
 #include "tuxctl-ld.h"
+#include "tuxctl-ioctl.h"
 
 #define uhoh(str, ...) printk(KERN_EMERG "%s " str, __FUNCTION__, ##__VA_ARGS__)
 #define debug(str, ...) printk(KERN_DEBUG "%s " str, __FUNCTION__,\
 							 ## __VA_ARGS__)
 
 /* Here's an interesting tidbit: tty_struct has no synchronization available
- * to us to protect against races involving the tty->disc_data field. So,
- * rather than do something tricky, we'll employ the 'one-big-freakin-lock'
- * strategy for synchronizing the methods in this file. This can't be a
- * semaphore because of the following chain of function calls:
+ * to us to protect against races involving the tty->disc_data field. The
+ * tty layer does promise that open() runs before, and close() after, every
+ * other method of the line discipline, though, so the pointer itself is
+ * stable while receive_buf(), ioctl() and friends run. What needs a lock
+ * is the data it points to, and that has to be a spinlock because of the
+ * following chain of function calls:
  *
  * rs_interrupt()  				(serial.c)
  *	tty_flip_buffer_push() 			(tty_io.c)
@@ -31,9 +34,10 @@
  *			ldisc.receive_buf() 	(this file)
  *
  * Specifically, rs_interrupt is, well, an interrupt. Sleeping in an 
- * interrupt is a recipe for breaking things, so a spinlock it is.
+ * interrupt is a recipe for breaking things, so a spinlock it is. Each
+ * tty has its own lock (in its disc_data), so that controllers on
+ * different serial ports don't contend with each other.
  */
-static spinlock_t tuxctl_ldisc_lock = SPIN_LOCK_UNLOCKED;
 
 
 /* Line Discipline specific stuff */
@@ -51,16 +55,17 @@ static void tuxctl_ldisc_rcv_buf(struct tty_struct*, const unsigned char *,
 static void tuxctl_ldisc_write_wakeup(struct tty_struct*);
 static void tuxctl_ldisc_data_callback(struct tty_struct *tty);
 
-#define TUXCTL_BUFSIZE 64
 typedef struct tuxctl_ldisc_data {
 	unsigned long magic;
 
-	char rx_buf[TUXCTL_BUFSIZE];
-	int rx_start, rx_end;
+	tuxctl_rx_t rx;		/* receive ring and packet parser */
 
 	char tx_buf[TUXCTL_BUFSIZE];
 	int tx_start, tx_end;
 
+	spinlock_t lock;	/* protects everything above and below */
+
+	struct tuxctl_dev *dev;	/* the driver's state for this controller */
 } tuxctl_ldisc_data_t;
 
 
@@ -70,6 +75,7 @@ static struct tty_ldisc tuxctl_ldisc  = {
 	.open = tuxctl_ldisc_open,
 	.close = tuxctl_ldisc_close,
         .ioctl = tuxctl_ioctl,
+	.poll = tuxctl_poll,
 	.receive_buf = tuxctl_ldisc_rcv_buf,
 	.write_wakeup = tuxctl_ldisc_write_wakeup,
 };
@@ -78,8 +84,16 @@ int __init
 tuxctl_ldisc_init(void)
 {
 	int err = 0;
+	tuxctl_debugfs_init();
+	if((err = tuxctl_state_init())){
+		debug("tuxctl state device register failed\n");
+		tuxctl_debugfs_exit();
+		return err;
+	}
 	if((err = tty_register_ldisc(N_MOUSE, &tuxctl_ldisc))){
 		debug("tuxctl line discipline register failed\n");
+		tuxctl_state_exit();
+		tuxctl_debugfs_exit();
 	}else{
 		printk("tuxctl line discipline registered\n");
 	}
@@ -91,46 +105,40 @@ void __exit
 tuxctl_ldisc_exit(void)
 {
 	tty_unregister_ldisc(N_MOUSE);
+	tuxctl_state_exit();
+	tuxctl_debugfs_exit();
 	printk("tuxctl line discipline removed\n");
 }
 module_exit(tuxctl_ldisc_exit);
 
-
-#define buf_used(start,end) ((start) <= (end) ? \
-				  ((end) - (start))  \
-				: (TUXCTL_BUFSIZE + (end) - (start)))
-
-#define buf_room(start,end) (TUXCTL_BUFSIZE - buf_used(start,end) - 1)
-
-#define buf_empty(start, end) ((start) == (end))
-#define buf_full(start, end) ((((end)+1)%TUXCTL_BUFSIZE) == (start))
-#define buf_incidx(idx) ((idx) = ((idx)+1) % TUXCTL_BUFSIZE)
+/* Needed for the kernel's monotonic clock (button event timestamps). */
+MODULE_LICENSE("GPL");
 
 
 static int 
 tuxctl_ldisc_open(struct tty_struct *tty)
 {
 	tuxctl_ldisc_data_t *data;
-	unsigned long flags;
 
 	if(!(data = kmalloc(sizeof(*data), GFP_KERNEL))){
 		uhoh("kmalloc failed!\n");
 		return -ENOMEM;
 	}
-	
-	spin_lock_irqsave(&tuxctl_ldisc_lock, flags);
+	if(!(data->dev = tuxctl_dev_alloc(tty))){
+		uhoh("kmalloc failed!\n");
+		kfree(data);
+		return -ENOMEM;
+	}
 
 	data->magic = TUXCTL_MAGIC;
+	spin_lock_init(&data->lock);
 
-	data->rx_start = 0;
-	data->rx_end = 0;
+	tuxctl_rx_init(&data->rx);
 
 	data->tx_start = 0;
 	data->tx_end = 0;
 	tty->disc_data = data;
 
-	spin_unlock_irqrestore(&tuxctl_ldisc_lock, flags);
-
 	return 0;
 }
 
@@ -138,16 +146,17 @@ static void
 tuxctl_ldisc_close(struct tty_struct *tty)
 {
 	tuxctl_ldisc_data_t *data; 
-	unsigned long flags;
-
-	spin_lock_irqsave(&tuxctl_ldisc_lock, flags);
 
 	data = tty->disc_data;
-	tty->disc_data = 0;
-
-	spin_unlock_irqrestore(&tuxctl_ldisc_lock, flags);
 
-	kfree(data);
+	if(data){
+		/* The driver's timers send through disc_data, so stop them
+		 * (by freeing the driver's state) before it goes away. */
+		tuxctl_dev_free(data->dev);
+		data->dev = NULL;
+		tty->disc_data = 0;
+		kfree(data);
+	}
 }
 
 
@@ -156,29 +165,32 @@ tuxctl_ldisc_close(struct tty_struct *tty)
  * from cp. fp points to some flag/error bytes which I conveniently ignore. 
  * This is called when there are bytes received from the serial driver, and
  * is called from an interrupt handler.
+ *
+ * The bytes are passed through the receive ring as many times as it takes
+ * to hold them; the parser empties the ring each time, so chunks of any
+ * size are received whole.
  */
 static void 
 tuxctl_ldisc_rcv_buf(struct tty_struct *tty, const unsigned char *cp, 
 			char *fp, int count)
 {
-	int call = 0, c=0;
 	unsigned long flags;
 	tuxctl_ldisc_data_t *data;
+	int n;
 
-	spin_lock_irqsave(&tuxctl_ldisc_lock, flags);
-	if(0 != (data = tty->disc_data)){
-		call = 1;
-
-		while(count-- > 0 && !buf_full(data->rx_start, data->rx_end)) {
-			data->rx_buf[data->rx_end] = *cp++;
-			buf_incidx(data->rx_end);
-			c++;
-		}
-	}
+	if(0 == (data = tty->disc_data))
+		return;
 
-	spin_unlock_irqrestore(&tuxctl_ldisc_lock, flags);
+	while(count > 0){
+		spin_lock_irqsave(&data->lock, flags);
+		n = buf_room(data->rx.start, data->rx.end);
+		if(n > count)
+			n = count;
+		tuxctl_rx_put(&data->rx, cp, n);
+		spin_unlock_irqrestore(&data->lock, flags);
+		cp += n;
+		count -= n;
 
-	if(call){
 		tuxctl_ldisc_data_callback(tty);
 	}
 }
@@ -194,29 +206,49 @@ tuxctl_ldisc_write_wakeup(struct tty_struct *tty)
 	char buf[TUXCTL_BUFSIZE];
 	unsigned long flags;
 
+	if(0 == (data = tty->disc_data))
+		return;
+
 	/* I hope that this doesn't need synchronization. */
 	room = tty->driver->write_room(tty);
-	
-	spin_lock_irqsave(&tuxctl_ldisc_lock, flags);
-	data = tty->disc_data;
 
-	while(n <= room && !buf_empty(data->tx_start, data->tx_end)){
+	spin_lock_irqsave(&data->lock, flags);
+
+	while(n < room && !buf_empty(data->tx_start, data->tx_end)){
 		buf[n++] = data->tx_buf[data->tx_start];
 		buf_incidx(data->tx_start);
 	}
 
-	spin_unlock_irqrestore(&tuxctl_ldisc_lock, flags);
+	spin_unlock_irqrestore(&data->lock, flags);
 
 	sent = tty->driver->write(tty, buf, n);
 
 	if(sent != n){
-		debug("driver lied to us? We lost some data");
+		/* already out of tx_buf, so the rest is gone; counted
+		 * rather than logged, as this can happen in an interrupt */
+		if(sent < 0)
+			sent = 0;
+		tuxctl_dev_tx_lost(data->dev, n - sent);
 	}
+	tuxctl_dev_tx_ready(data->dev);
 }
 
 /*********** Interface to the char driver ********************/
 
 
+/* tuxctl_ldisc_dev()
+ * Returns the driver's state for the controller on a tty, or NULL if the
+ * line discipline isn't attached to it.
+ */
+struct tuxctl_dev *
+tuxctl_ldisc_dev(struct tty_struct *tty)
+{
+	tuxctl_ldisc_data_t *data = tty->disc_data;
+
+	return data ? data->dev : NULL;
+}
+
+
 /* tuxctl_ldisc_get()
  * Read bytes that the line-discipline has received from the controller.
  * Returns the number of bytes actually read, or  -1 on error (if, for
@@ -229,22 +261,23 @@ tuxctl_ldisc_get(struct tty_struct *tty, char *buf, int n)
 	unsigned long flags;
 	int r = 0;
 
-	spin_lock_irqsave(&tuxctl_ldisc_lock, flags);
 	data = tty->disc_data;
-	while(n-- > 0 && !buf_empty(data->rx_start, data->rx_end)){
-		*buf++ = data->rx_buf[data->rx_start];
-		buf_incidx(data->rx_start);
+	spin_lock_irqsave(&data->lock, flags);
+	while(n-- > 0 && !buf_empty(data->rx.start, data->rx.end)){
+		*buf++ = data->rx.buf[data->rx.start];
+		buf_incidx(data->rx.start);
 		r++;
 	}
-	spin_unlock_irqrestore(&tuxctl_ldisc_lock, flags);
+	spin_unlock_irqrestore(&data->lock, flags);
 
 	return r;
 }
 
 /* tuxctl_ldisc_put()
  * Write bytes out to the device. Returns the number of bytes *not* written.
- * This means, 0 on success and >0 if the line discipline's internal buffer
- * is full.
+ * This means, 0 on success and n if the line discipline's internal buffer
+ * doesn't have room for all n bytes, or it has been detached from the tty
+ * (none are written).
  */
 int 
 tuxctl_ldisc_put(struct tty_struct *tty, char const *buf, int n)
@@ -252,9 +285,17 @@ tuxctl_ldisc_put(struct tty_struct *tty, char const *buf, int n)
 	tuxctl_ldisc_data_t *data;
 	unsigned long flags;
 
-	spin_lock_irqsave(&tuxctl_ldisc_lock, flags);
+	if(0 == (data = tty->disc_data))
+		return n;
 
-	data = tty->disc_data;
+	spin_lock_irqsave(&data->lock, flags);
+
+	/* All or nothing: a partly sent command would garble the ones 
+	 * after it. */
+	if (n > buf_room(data->tx_start, data->tx_end)) {
+		spin_unlock_irqrestore(&data->lock, flags);
+		return n;
+	}
 
 	while (n > 0 && !buf_full(data->tx_start, data->tx_end)) {
 		data->tx_buf[data->tx_end] = *buf++;
@@ -262,7 +303,7 @@ tuxctl_ldisc_put(struct tty_struct *tty, char const *buf, int n)
 		--n;
 	}
 
-	spin_unlock_irqrestore(&tuxctl_ldisc_lock, flags);
+	spin_unlock_irqrestore(&data->lock, flags);
 
 	/* Potential race conditions here ...  ?*/
 
@@ -275,44 +316,34 @@ tuxctl_ldisc_put(struct tty_struct *tty, char const *buf, int n)
  * This is the function called from the line-discipline when data is
  * available from the device. This is how responses to polling the buttons
  * and ACK's for setting the LEDs will be transmitted to the tuxctl driver.
- * The tuxctl driver must implement this function. The 'tty' parameter
- * can be passed back to the tuxctl_ldisc_read function to read
- * data from the lower-level buffers.
+ * The tuxctl driver must implement tuxctl_handle_packets, which this
+ * calls with every complete packet received.
  *
  * IMPORTANT: This function is called from an interrupt context, so it 
  *            cannot acquire any semaphores or otherwise sleep, or access
  *            the 'current' pointer. It also must not take up too much time.
+ *
+ * The whole receive buffer goes through the packet parser (see
+ * tuxctl_rx_parse), and the packets found are handed over in one batch,
+ * after the lock is dropped, as are the receive counters.
  */
 static void tuxctl_ldisc_data_callback(struct tty_struct *tty)
 {
-	/* Should probably synchronize these */
-	static unsigned char saved[2];
-	static int n_saved = 0;
-	
-	unsigned char packet[12], *p;
-	int n, i = 0, j;
-
-	for(i=0; i< n_saved; i++)
-		packet[i] = saved[i];
-	
-	n = n_saved + tuxctl_ldisc_get(tty, packet + n_saved,  12 - n_saved);
-
-	/* Look at all bytes as potential packet beginnings except for 
-	 * the last two bytes. Save them for next time. */
-	for(i = 0; i < n-2; ){
-		p = packet + i;
-
-		/* Check the framing bits to detect lost bytes */
-		if(!(p[0]&0x80) && p[1]&0x80 && p[2]&0x80){
-			tuxctl_handle_packet(tty, p);
-			i += 3;
-		}else{
-			i++;
-		}
-	}
-
-	/* Save the leftovers - extra bytes for breakfast */
-	n_saved = n - i;
-	for(j = 0; j < n_saved; j++)
-		saved[j] = packet[i+j];
+	tuxctl_ldisc_data_t *data = tty->disc_data;
+	unsigned char packets[TUXCTL_RX_MAX_PACKETS][TUXCTL_PACKET_LEN];
+	struct tux_stats st;
+	unsigned long flags;
+	int n;
+
+	spin_lock_irqsave(&data->lock, flags);
+	n = tuxctl_rx_parse(&data->rx, packets);
+	st.rx_packets = data->rx.packets;
+	st.rx_framing_errors = data->rx.framing_errors;
+	st.rx_resyncs = data->rx.resyncs;
+	st.rx_overruns = data->rx.overruns;
+	spin_unlock_irqrestore(&data->lock, flags);
+
+	tuxctl_dev_rx_stats(data->dev, &st);
+	if(n > 0)
+		tuxctl_handle_packets(tty, packets, n);
 }
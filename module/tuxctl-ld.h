@@ -6,6 +6,8 @@
 #include <linux/fs.h>
 #include <linux/tty.h>
 
+#include "tuxctl-rx.h"
+
 /* tuxctl-ld.h
  * Interface between line discipline and driver */
 
@@ -19,21 +21,78 @@ extern int tuxctl_ldisc_get(struct tty_struct*, char *, int);
 
 /* tuxctl_ldisc_put()
  * Write bytes out to the device. Returns the number of bytes *not* written.
- * This means, 0 on success and >0 if the line discipline's internal buffer
- * is full.
+ * This means, 0 on success and n if the line discipline's internal buffer
+ * doesn't have room for all n bytes, or it has been detached from the tty
+ * (none are written).
  */
 extern int tuxctl_ldisc_put(struct tty_struct*, char const*, int);
 
-/* tuxctl_handle_packet
- * To be written by the student.  This function will handle a 
- * packet sent to the computer from the tux controller.  This is
- * called by tuxctl_ldisc_data_callback().
+/* tuxctl_ldisc_dev()
+ * Returns the driver's state for the controller on a tty (allocated with
+ * tuxctl_dev_alloc when the line discipline is attached, and freed with
+ * tuxctl_dev_free when it is detached), or NULL if there is none.
+ */
+struct tuxctl_dev;
+extern struct tuxctl_dev *tuxctl_ldisc_dev(struct tty_struct *);
+
+/* tuxctl_state_init(), tuxctl_state_exit()
+ * Register and remove the device through which the state pages are
+ * mapped (see TUX_GET_STATE_OFFSET), located in tuxctl.c.
+ */
+extern int tuxctl_state_init(void);
+extern void tuxctl_state_exit(void);
+
+/* tuxctl_debugfs_init(), tuxctl_debugfs_exit()
+ * Create and remove the driver's debugfs directory, where each controller
+ * has a file of debugging counters; located in tuxctl.c. The driver works
+ * without it, so there is no error to return.
+ */
+extern void tuxctl_debugfs_init(void);
+extern void tuxctl_debugfs_exit(void);
+
+/* tuxctl_dev_alloc(), tuxctl_dev_free()
+ * Allocate and free the per-controller state for a tty, located in
+ * tuxctl.c. tuxctl_dev_alloc returns NULL if out of memory.
  */
-void tuxctl_handle_packet(struct tty_struct *tty, unsigned char *packet);
+extern struct tuxctl_dev *tuxctl_dev_alloc(struct tty_struct *);
+extern void tuxctl_dev_free(struct tuxctl_dev *);
+
+/* tuxctl_dev_rx_stats(), tuxctl_dev_tx_lost()
+ * Keep the line discipline's counters with the driver's state, where
+ * TUX_GET_STATS and debugfs find them; located in tuxctl.c.
+ * tuxctl_dev_rx_stats copies the receive counters (rx_*) of a struct
+ * tux_stats, and takes the device lock. tuxctl_dev_tx_lost adds bytes to
+ * tx_lost without taking it, as the transmit path runs with it held.
+ */
+struct tux_stats;
+extern void tuxctl_dev_rx_stats(struct tuxctl_dev *, const struct tux_stats *);
+extern void tuxctl_dev_tx_lost(struct tuxctl_dev *, int);
+
+/* tuxctl_dev_tx_ready()
+ * Tells the driver that the serial driver can take more bytes, so that
+ * it can retry a command that didn't fit in the transmit buffer; located
+ * in tuxctl.c. Doesn't take the device lock.
+ */
+extern void tuxctl_dev_tx_ready(struct tuxctl_dev *);
+
+/* tuxctl_handle_packets
+ * To be written by the student.  This function will handle a batch
+ * of n packets sent to the computer from the tux controller, oldest
+ * first.  This is called by tuxctl_ldisc_data_callback().
+ */
+void tuxctl_handle_packets(struct tty_struct *tty,
+			   unsigned char packets[][TUXCTL_PACKET_LEN], int n);
 
 
 /* ioctl for the line discipline that the students will implement.
  * Located in tuxctl.c
  */
 extern int tuxctl_ioctl(struct tty_struct * tty, struct file *, unsigned int cmd, unsigned long arg);
+
+/* poll for the line discipline, also located in tuxctl.c: readable while
+ * button events are queued.
+ */
+struct poll_table_struct;
+extern unsigned int tuxctl_poll(struct tty_struct *, struct file *,
+				struct poll_table_struct *);
 #endif
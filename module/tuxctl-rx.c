@@ -0,0 +1,91 @@
+/* tuxctl-rx.c
+ * Receive ring and MTCP packet parser for the Tux controller line
+ * discipline (see tuxctl-rx.h).
+ */
+
+#if defined(__KERNEL__)
+#include <linux/string.h>
+#else
+#include <string.h>
+#endif
+
+#include "tuxctl-rx.h"
+
+
+void
+tuxctl_rx_init(tuxctl_rx_t *rx)
+{
+	rx->start = 0;
+	rx->end = 0;
+	rx->pkt_len = 0;
+	rx->lost_sync = 0;
+	rx->packets = 0;
+	rx->framing_errors = 0;
+	rx->resyncs = 0;
+	rx->overruns = 0;
+}
+
+int
+tuxctl_rx_put(tuxctl_rx_t *rx, const unsigned char *cp, int count)
+{
+	int n = 0;
+
+	while(n < count && !buf_full(rx->start, rx->end)) {
+		rx->buf[rx->end] = cp[n++];
+		buf_incidx(rx->end);
+	}
+	rx->overruns += count - n;
+	return n;
+}
+
+/* The whole ring is consumed, one byte at a time, by a state machine that
+ * keeps the partly received packet in rx, so packets may be split across
+ * calls in any way. The first byte of an MTCP packet has its high bit
+ * clear and the other two have it set (see mtcp.h); a byte that breaks
+ * this rule is a framing error. A clear high bit always starts a new
+ * packet (abandoning a partial one), and a set high bit with no packet
+ * started is thrown away, so the parser is back in step with the
+ * controller at the next packet that arrives intact.
+ */
+int
+tuxctl_rx_parse(tuxctl_rx_t *rx, unsigned char packets[][TUXCTL_PACKET_LEN])
+{
+	unsigned char c;
+	int n = 0;
+
+	while(!buf_empty(rx->start, rx->end)){
+		c = rx->buf[rx->start];
+		buf_incidx(rx->start);
+
+		if(!(c & 0x80)){
+			/* first byte of a packet */
+			if(rx->pkt_len != 0 && !rx->lost_sync){
+				rx->framing_errors++;
+				rx->lost_sync = 1;
+			}
+			rx->pkt[0] = c;
+			rx->pkt_len = 1;
+			continue;
+		}
+		if(rx->pkt_len == 0){
+			/* a stray data byte */
+			if(!rx->lost_sync){
+				rx->framing_errors++;
+				rx->lost_sync = 1;
+			}
+			continue;
+		}
+		rx->pkt[rx->pkt_len++] = c;
+		if(rx->pkt_len < TUXCTL_PACKET_LEN)
+			continue;
+
+		memcpy(packets[n++], rx->pkt, TUXCTL_PACKET_LEN);
+		rx->pkt_len = 0;
+		rx->packets++;
+		if(rx->lost_sync){
+			rx->resyncs++;
+			rx->lost_sync = 0;
+		}
+	}
+	return n;
+}
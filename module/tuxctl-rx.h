@@ -0,0 +1,73 @@
+#ifndef TUXCTL_RX_H
+#define TUXCTL_RX_H
+
+/* tuxctl-rx.h
+ * Receive ring and MTCP packet parser for the Tux controller line
+ * discipline.
+ *
+ * Bytes from the serial driver are stored in a ring of TUXCTL_BUFSIZE
+ * bytes (in interrupt context), and the parser then takes them out and
+ * reassembles them into 3-byte packets, keeping a partly received packet
+ * between calls. The ring does no locking of its own; the line discipline
+ * holds its lock around every call.
+ *
+ * The same code builds as part of a user program (see the tux-emu target
+ * in the Makefile), so that the receive path can be run and timed against
+ * an emulated controller off-hardware.
+ */
+
+#define TUXCTL_BUFSIZE 64
+#define TUXCTL_PACKET_LEN 3
+
+/* the most packets that one call to tuxctl_rx_parse can return */
+#define TUXCTL_RX_MAX_PACKETS (TUXCTL_BUFSIZE / TUXCTL_PACKET_LEN + 1)
+
+/* Ring arithmetic, shared with the line discipline's transmit ring. One
+ * slot is always left empty, so that start == end means empty. */
+#define buf_used(start,end) ((start) <= (end) ? \
+				  ((end) - (start))  \
+				: (TUXCTL_BUFSIZE + (end) - (start)))
+
+#define buf_room(start,end) (TUXCTL_BUFSIZE - buf_used(start,end) - 1)
+
+#define buf_empty(start, end) ((start) == (end))
+#define buf_full(start, end) ((((end)+1)%TUXCTL_BUFSIZE) == (start))
+#define buf_incidx(idx) ((idx) = ((idx)+1) % TUXCTL_BUFSIZE)
+
+typedef struct tuxctl_rx {
+	unsigned char buf[TUXCTL_BUFSIZE];
+	int start, end;
+
+	/* the bytes of the packet being received, and whether bytes have
+	 * been thrown away since the last good one */
+	unsigned char pkt[TUXCTL_PACKET_LEN];
+	int pkt_len;
+	int lost_sync;
+
+	unsigned int packets;		/* whole packets found */
+	unsigned int framing_errors;	/* runs of bytes thrown away */
+	unsigned int resyncs;		/* packets found after such a run */
+	unsigned int overruns;		/* bytes dropped with the ring full */
+} tuxctl_rx_t;
+
+/* tuxctl_rx_init()
+ * Empty the ring, forget any partial packet, and clear the counters.
+ */
+extern void tuxctl_rx_init(tuxctl_rx_t *rx);
+
+/* tuxctl_rx_put()
+ * Add up to count bytes to the ring. Bytes that don't fit are dropped and
+ * counted as overruns. Returns the number of bytes stored.
+ */
+extern int tuxctl_rx_put(tuxctl_rx_t *rx, const unsigned char *cp,
+			 int count);
+
+/* tuxctl_rx_parse()
+ * Empty the ring through the packet parser, copying each complete packet
+ * into packets[], which must have room for TUXCTL_RX_MAX_PACKETS, oldest
+ * first. Returns the number of packets copied.
+ */
+extern int tuxctl_rx_parse(tuxctl_rx_t *rx,
+			   unsigned char packets[][TUXCTL_PACKET_LEN]);
+
+#endif
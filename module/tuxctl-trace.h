@@ -0,0 +1,84 @@
+/* tuxctl-trace.h
+ * Tracepoints for the Tux controller driver: one as each packet from a
+ * controller is handled, and one as each command is sent to it. With
+ * the kernel's event tracing (events/tuxctl/ in the tracing directory),
+ * the time between a command and its MTCP_ACK, or between a button
+ * press and the game's reaction, can be measured without changing the
+ * driver. dev is the controller's index (see TUX_GET_STATE_OFFSET).
+ *
+ * Kernels older than 2.6.32 have no TRACE_EVENT, so there the trace
+ * calls compile to nothing.
+ */
+
+#include <linux/version.h>
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2, 6, 32)
+
+#ifndef TUXCTL_TRACE_H
+#define TUXCTL_TRACE_H
+
+static inline void
+trace_tuxctl_packet_rx(int dev, const unsigned char *packet)
+{
+}
+
+static inline void
+trace_tuxctl_cmd_tx(int dev, const unsigned char *buf, int len, int ack)
+{
+}
+
+#endif /* TUXCTL_TRACE_H */
+
+#else
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM tuxctl
+
+#if !defined(TUXCTL_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define TUXCTL_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(tuxctl_packet_rx,
+	TP_PROTO(int dev, const unsigned char *packet),
+	TP_ARGS(dev, packet),
+	TP_STRUCT__entry(
+		__field(int, dev)
+		__array(unsigned char, packet, 3)
+	),
+	TP_fast_assign(
+		__entry->dev = dev;
+		memcpy(__entry->packet, packet, 3);
+	),
+	TP_printk("dev=%d packet=%02x %02x %02x", __entry->dev,
+		  __entry->packet[0], __entry->packet[1], __entry->packet[2])
+);
+
+TRACE_EVENT(tuxctl_cmd_tx,
+	TP_PROTO(int dev, const unsigned char *buf, int len, int ack),
+	TP_ARGS(dev, buf, len, ack),
+	TP_STRUCT__entry(
+		__field(int, dev)
+		__field(unsigned char, opcode)
+		__field(int, len)
+		__field(int, ack)
+	),
+	TP_fast_assign(
+		__entry->dev = dev;
+		__entry->opcode = buf[0];
+		__entry->len = len;
+		__entry->ack = ack;
+	),
+	TP_printk("dev=%d opcode=%02x len=%d ack=%d", __entry->dev,
+		  __entry->opcode, __entry->len, __entry->ack)
+);
+
+#endif /* TUXCTL_TRACE_H */
+
+/* this part must be outside the include guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#define TRACE_INCLUDE_FILE tuxctl-trace
+#include <trace/define_trace.h>
+
+#endif /* LINUX_VERSION_CODE */
@@ -36,6 +36,7 @@
  */
 
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "assert.h"
@@ -45,31 +46,15 @@
 #include "world.h"
 #include "octree.h"
 
-/* macro used to write a byte to a port */
-#define OUTB(port,val)                                                  \
-do {                                                                    \
-    asm volatile ("                                                     \
-        outb %b1,(%w0)                                                  \
-    " : /* no outputs */                                                \
-      : "d" ((port)), "a" ((val))                                       \
-      : "memory", "cc");                                                \
-} while (0)
-
 /* 
- * macro used to write an array of one-byte values to two consecutive ports 
+ * When USE_ROOM_CANVAS is non-zero, prep_room composes the whole room
+ * (photo and objects) into a planar canvas, and the mode X code copies
+ * lines from the canvas while scrolling rather than calling the fill
+ * functions.  At most MAX_CANVAS_OBJECTS objects in a room are tracked
+ * for incremental updates; rooms with more are recomposed in full.
  */
-#define REP_OUTSB(port,source,count)                                    \
-do {                                                                    \
-    asm volatile ("                                                     \
-     1: movb 0(%1),%%al                                                ;\
-	outb %%al,(%w2)                                                ;\
-	incl %1                                                        ;\
-	decl %0                                                        ;\
-	jne 1b                                                          \
-    " : /* no outputs */                                                \
-      : "c" ((count)), "S" ((source)), "d" ((port))                     \
-      : "eax", "memory", "cc");                                         \
-} while (0)
+#define USE_ROOM_CANVAS     1
+#define MAX_CANVAS_OBJECTS  32
 
 /* types local to this file (declared in types.h) */
 
@@ -112,6 +97,58 @@ struct image_t {
  */
 static const room_t* cur_room = NULL; 
 
+/*
+ * Shadow copy of the VGA DAC as last written by prep_room.  Only colors
+ * that differ from the shadow are sent to the DAC on a room change; the
+ * shadow is not valid until the first full upload.  Nothing else writes
+ * the palette while mode X is active (set_mode_X writes only the fixed
+ * 64 object colors, which are also the first 64 entries here).
+ */
+static unsigned char dac_shadow[256][3];
+static int dac_shadow_valid = 0;
+static palette_stats_t palette_stats;
+
+/*
+ * Objects are drawn over the room photo by the fill functions unless 
+ * overlay_objects has been turned off (see set_object_overlay), in which
+ * case objects_skipped records that some line was drawn without them.
+ * The canvas is always composed with objects.
+ */
+static int overlay_objects = 1;
+static int objects_skipped = 0;
+
+/* 
+ * The planar canvas for the current room, in the layout described in 
+ * modex.h, and the room state from which it was composed: the photo,
+ * the room version, and the area covered by each object.  An object
+ * rectangle is damaged (must be recomposed) when it appears in only one
+ * of the recorded and current object lists.
+ */
+typedef struct canvas_obj_t canvas_obj_t;
+struct canvas_obj_t {
+    const object_t* obj;	/* the object                    */
+    int32_t x, y;		/* upper left pixel of object    */
+    int32_t w, h;		/* width and height of its image */
+};
+static unsigned char*  canvas;		/* planar room image              */
+static size_t          canvas_alloc;	/* bytes allocated for canvas     */
+static int             canvas_width;	/* width in addresses             */
+static int             canvas_height;	/* height in pixels               */
+static const room_t*   canvas_room;	/* room composed, or NULL         */
+static const photo_t*  canvas_photo;	/* photo composed                 */
+static uint32_t        canvas_version;	/* room version composed          */
+static int             canvas_n_objs;	/* objects recorded, or -1 if too */
+					/*    many to track               */
+static canvas_obj_t    canvas_objs[MAX_CANVAS_OBJECTS];
+
+
+/* local functions--see function headers for details */
+static int record_objects (canvas_obj_t objs[MAX_CANVAS_OBJECTS]);
+static int find_canvas_obj (const canvas_obj_t* o, 
+			    const canvas_obj_t objs[], int n);
+static void compose_canvas (int x0, int y0, int x1, int y1);
+static void update_canvas ();
+
 
 /* 
  * fill_horiz_buffer
@@ -121,7 +158,7 @@ static const room_t* cur_room = NULL;
  *                is represented as a single byte in the image.
  *
  *                Note that this routine draws both the room photo and
- *                the objects in the room.
+ *                the objects in the room (unless object overlay is off).
  *
  *   INPUTS: (x,y) -- leftmost pixel of line to be drawn 
  *   OUTPUTS: buf -- buffer holding image data for the line
@@ -150,6 +187,12 @@ fill_horiz_buffer (int x, int y, unsigned char buf[SCROLL_X_DIM])
 		    view->img[view->hdr.width * y + x + idx] : 0);
     }
 
+    /* Skip the objects if asked to do so. */
+    if (!overlay_objects) {
+	objects_skipped = 1;
+	return;
+    }
+
     /* Loop over objects in the current room. */
     for (obj = room_contents_iterate (cur_room); NULL != obj;
     	 obj = obj_next (obj)) {
@@ -199,7 +242,7 @@ fill_horiz_buffer (int x, int y, unsigned char buf[SCROLL_X_DIM])
  *                is represented as a single byte in the image.
  *
  *                Note that this routine draws both the room photo and
- *                the objects in the room.
+ *                the objects in the room (unless object overlay is off).
  *
  *   INPUTS: (x,y) -- top pixel of line to be drawn 
  *   OUTPUTS: buf -- buffer holding image data for the line
@@ -228,6 +271,12 @@ fill_vert_buffer (int x, int y, unsigned char buf[SCROLL_Y_DIM])
 		    view->img[view->hdr.width * (y + idx) + x] : 0);
     }
 
+    /* Skip the objects if asked to do so. */
+    if (!overlay_objects) {
+	objects_skipped = 1;
+	return;
+    }
+
     /* Loop over objects in the current room. */
     for (obj = room_contents_iterate (cur_room); NULL != obj;
     	 obj = obj_next (obj)) {
@@ -380,6 +429,7 @@ prep_room (const room_t* r)
 };
 
 	int i;
+	int end;   /* one past the last color of a changed range */
 	for (i = 0; i < 192; i++)
 	{
 		palette_RGB[i + 64][0] = cur_photo->palette[i][0];
@@ -387,11 +437,345 @@ prep_room (const room_t* r)
 		palette_RGB[i + 64][2] = cur_photo->palette[i][2];		
 	}
 
-	/* start writing at color 0. */
-	OUTB (0x03C8, 0x00);
+	/* 
+	 * Write each maximal run of colors that differ from the shadow DAC
+	 * (deferred to retrace with vsync).  On the first call, all 256
+	 * colors form a single run.
+	 */
+	palette_stats.room_changes++;
+	palette_stats.last_dac_bytes = 0;
+	for (i = 0; 256 > i; i = end + 1) {
+	    if (dac_shadow_valid && 
+	        0 == memcmp (dac_shadow[i], palette_RGB[i], 3)) {
+		end = i;
+		continue;
+	    }
+	    for (end = i + 1; 256 > end; end++) {
+		if (dac_shadow_valid && 
+		    0 == memcmp (dac_shadow[end], palette_RGB[end], 3)) {
+		    break;
+		}
+	    }
+	    set_palette (i, end - i, &palette_RGB[i]);
+	    (void)memcpy (dac_shadow[i], palette_RGB[i], (end - i) * 3);
+	    palette_stats.dac_ranges++;
+	    palette_stats.last_dac_bytes += (end - i) * 3;
+	}
+	dac_shadow_valid = 1;
+	palette_stats.dac_bytes += palette_stats.last_dac_bytes;
+
+	/* Compose the room canvas if that rendering mode is used. */
+	if (USE_ROOM_CANVAS) {
+	    update_canvas ();
+	}
+}
+
+
+/* 
+ * refresh_room
+ *   DESCRIPTION: Bring any pre-rendered image of the current room up to
+ *                date after objects in the room have moved (or the room
+ *                photo has been swapped).  Only the areas covered by
+ *                objects that moved are recomposed.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may recompose parts of the room canvas
+ */
+void
+refresh_room ()
+{
+    if (USE_ROOM_CANVAS && NULL != cur_room) {
+	update_canvas ();
+    }
+}
+
+
+/* 
+ * set_object_overlay
+ *   DESCRIPTION: Turn the drawing of objects by the fill functions on or
+ *                off.  Lines copied from the room canvas always include
+ *                the objects.
+ *   INPUTS: on -- 1 to draw objects, 0 to draw only the room photo
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if overlay is being turned on and lines have been
+ *                 drawn without objects since it was turned off (so that
+ *                 the caller should redraw the room), or 0 otherwise
+ *   SIDE EFFECTS: none
+ */
+int
+set_object_overlay (int on)
+{
+    int skipped = (on && objects_skipped); /* lines lack objects */
+
+    overlay_objects = on;
+    if (on) {
+	objects_skipped = 0;
+    }
+    return skipped;
+}
+
+
+/* 
+ * object_overlay_saves
+ *   DESCRIPTION: Tell whether turning off the object overlay (see 
+ *                set_object_overlay) saves any drawing.  It does not 
+ *                while lines of the current room are copied from the
+ *                room canvas, which always includes the objects.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if lines are drawn by the fill functions, or 0 if
+ *                 they are copied from the canvas
+ *   SIDE EFFECTS: none
+ */
+int
+object_overlay_saves ()
+{
+    return !(USE_ROOM_CANVAS && NULL != cur_room && cur_room == canvas_room);
+}
+
+
+/* 
+ * record_objects
+ *   DESCRIPTION: Record the area covered by each object in the current
+ *                room.
+ *   INPUTS: none
+ *   OUTPUTS: objs -- the object areas
+ *   RETURN VALUE: the number of objects, or -1 if there are more than
+ *                 MAX_CANVAS_OBJECTS
+ *   SIDE EFFECTS: none
+ */
+static int
+record_objects (canvas_obj_t objs[MAX_CANVAS_OBJECTS])
+{
+    object_t* obj;  /* loop index over objects in the current room */
+    int n;	    /* number of objects recorded                  */
+
+    n = 0;
+    for (obj = room_contents_iterate (cur_room); NULL != obj;
+    	 obj = obj_next (obj)) {
+	if (MAX_CANVAS_OBJECTS == n) {
+	    return -1;
+	}
+	objs[n].obj = obj;
+	objs[n].x = obj_get_x (obj);
+	objs[n].y = obj_get_y (obj);
+	objs[n].w = obj_image (obj)->hdr.width;
+	objs[n].h = obj_image (obj)->hdr.height;
+	n++;
+    }
+    return n;
+}
+
+
+/* 
+ * find_canvas_obj
+ *   DESCRIPTION: Check whether an object area appears in a list of areas.
+ *   INPUTS: o -- the object area
+ *           objs -- the list of object areas
+ *           n -- number of areas in the list
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if an identical area for the same object is found,
+ *                 or 0 if not
+ *   SIDE EFFECTS: none
+ */
+static int
+find_canvas_obj (const canvas_obj_t* o, const canvas_obj_t objs[], int n)
+{
+    int i;  /* loop index over list */
+
+    for (i = 0; n > i; i++) {
+	if (o->obj == objs[i].obj && o->x == objs[i].x && o->y == objs[i].y &&
+	    o->w == objs[i].w && o->h == objs[i].h) {
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+
+/* 
+ * compose_canvas
+ *   DESCRIPTION: Draw a rectangle of the current room (photo and objects)
+ *                into the canvas, clipped to the canvas.
+ *   INPUTS: (x0,y0) -- upper left pixel of rectangle
+ *           (x1,y1) -- pixel just below and to the right of rectangle
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws into the canvas
+ */
+static void
+compose_canvas (int x0, int y0, int x1, int y1)
+{
+    unsigned char buf[SCROLL_X_DIM]; /* image of part of a line      */
+    int plane;			     /* size of one canvas plane     */
+    int x, y;			     /* loop indices over rectangle  */
+    int i;			     /* loop index over buf          */
+    int overlay;		     /* saved object overlay setting */
+
+    if (0 > x0) {x0 = 0;}
+    if (0 > y0) {y0 = 0;}
+    if (canvas_width * 4 < x1) {x1 = canvas_width * 4;}
+    if (canvas_height < y1) {y1 = canvas_height;}
+
+    plane = canvas_width * canvas_height;
+    overlay = overlay_objects;
+    overlay_objects = 1;
+    for (y = y0; y1 > y; y++) {
+	for (x = x0; x1 > x; x += SCROLL_X_DIM) {
+	    fill_horiz_buffer (x, y, buf);
+	    for (i = 0; SCROLL_X_DIM > i && x1 > x + i; i++) {
+		canvas[((x + i) & 3) * plane + y * canvas_width + 
+		       ((x + i) >> 2)] = buf[i];
+	    }
+	}
+    }
+    overlay_objects = overlay;
+}
+
+
+/* 
+ * update_canvas
+ *   DESCRIPTION: Make the canvas match the current room.  A new room or
+ *                photo is composed in full; otherwise, only the areas of
+ *                objects that have moved, appeared, or disappeared since
+ *                the canvas was last composed are redrawn.  If the canvas
+ *                cannot be allocated, lines are drawn with the fill 
+ *                functions instead.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may (re)allocate and draw into the canvas; selects the
+ *                 canvas for use by the mode X code
+ */
+static void
+update_canvas ()
+{
+    canvas_obj_t objs[MAX_CANVAS_OBJECTS]; /* current object areas  */
+    const photo_t* view;		   /* current room photo     */
+    size_t size;			   /* canvas size in bytes   */
+    int n_objs;				   /* current object count   */
+    int i;				   /* loop index over areas  */
+
+    view = room_photo (cur_room);
+    if (cur_room == canvas_room && view == canvas_photo &&
+        room_version (cur_room) == canvas_version) {
+	return;
+    }
+    n_objs = record_objects (objs);
+
+    if (cur_room != canvas_room || view != canvas_photo || 
+        0 > n_objs || 0 > canvas_n_objs) {
+
+	/* Compose the whole room into a (possibly larger) canvas. */
+	set_canvas (NULL, 0, 0);
+	canvas_room = NULL;
+	canvas_width = (view->hdr.width + 3) / 4;
+	canvas_height = view->hdr.height;
+	size = (size_t)canvas_width * canvas_height * 4;
+	if (canvas_alloc < size) {
+	    free (canvas);
+	    canvas_alloc = 0;
+	    if (NULL == (canvas = malloc (size))) {
+		return;
+	    }
+	    canvas_alloc = size;
+	}
+	compose_canvas (0, 0, canvas_width * 4, canvas_height);
+
+    } else {
+
+	/* Recompose only the damaged areas. */
+	for (i = 0; canvas_n_objs > i; i++) {
+	    if (!find_canvas_obj (&canvas_objs[i], objs, n_objs)) {
+		compose_canvas (canvas_objs[i].x, canvas_objs[i].y,
+		                canvas_objs[i].x + canvas_objs[i].w,
+		                canvas_objs[i].y + canvas_objs[i].h);
+	    }
+	}
+	for (i = 0; n_objs > i; i++) {
+	    if (!find_canvas_obj (&objs[i], canvas_objs, canvas_n_objs)) {
+		compose_canvas (objs[i].x, objs[i].y, objs[i].x + objs[i].w,
+		                objs[i].y + objs[i].h);
+	    }
+	}
+    }
+
+    /* Record the state composed and let the mode X code use the canvas. */
+    canvas_room = cur_room;
+    canvas_photo = view;
+    canvas_version = room_version (cur_room);
+    canvas_n_objs = n_objs;
+    if (0 < n_objs) {
+	(void)memcpy (canvas_objs, objs, n_objs * sizeof (objs[0]));
+    }
+    set_canvas (canvas, canvas_width, canvas_height);
+}
+
+
+/* 
+ * get_palette_stats
+ *   DESCRIPTION: Read the DAC upload counters maintained by prep_room.
+ *   INPUTS: none
+ *   OUTPUTS: stats -- counters since the program started
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+get_palette_stats (palette_stats_t* stats)
+{
+    *stats = palette_stats;
+}
+
+
+/*
+ * prefault_obj_image
+ *   DESCRIPTION: Prefault the pixel data of an object image.
+ *   INPUTS: im -- the image
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may page-fault
+ */
+void
+prefault_obj_image (image_t* im)
+{
+    prefault_pages (im->img, im->hdr.width * im->hdr.height);
+}
+
 
-	/* Write all 64 colors from array. */
-	REP_OUTSB (0x03C9, palette_RGB, 256 * 3);
+/*
+ * prefault_photo
+ *   DESCRIPTION: Prefault the pixel data of a room photo and, if rooms are
+ *                drawn from a canvas, grow the canvas to hold the photo
+ *                now and prefault it too, so that neither entering the 
+ *                room nor scrolling over it later touches new pages.
+ *   INPUTS: p -- the photo
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may page-fault; may reallocate the canvas (which is 
+ *                 then composed again when next used)
+ */
+void
+prefault_photo (photo_t* p)
+{
+    size_t size; /* canvas size for photo in bytes */
+
+    prefault_pages (p->img, p->hdr.width * p->hdr.height);
+    if (!USE_ROOM_CANVAS) {
+	return;
+    }
+    size = (size_t)(p->hdr.width + 3) / 4 * p->hdr.height * 4;
+    if (canvas_alloc < size) {
+	set_canvas (NULL, 0, 0);
+	canvas_room = NULL;
+	free (canvas);
+	canvas_alloc = 0;
+	if (NULL == (canvas = malloc (size))) {
+	    return;
+	}
+	canvas_alloc = size;
+    }
+    prefault_pages (canvas, canvas_alloc);
 }
 
 
@@ -549,7 +933,14 @@ read_photo (const char* fname)
 	}
 }
 	make_palette(p->palette, row_four, palette_to_pixel);
-	rewind(in);
+
+	/* read the pixels again, skipping the header */
+	if (0 != fseek (in, sizeof (p->hdr), SEEK_SET)) {
+	    free (p->img);
+	    free (p);
+	    (void)fclose (in);
+	    return NULL;
+	}
 
 	    for (y = p->hdr.height; y-- > 0; ) {
 		/* Loop over columns from left to right. */
@@ -577,7 +968,7 @@ read_photo (const char* fname)
 	     * to match the colors needed for that photo.
 	     */
 	     /* map the pixels with the palette */
-	    p->img[p->hdr.width * y + x - 2] = (row_two_size + search_palette(pixel, palette_to_pixel));
+	    p->img[p->hdr.width * y + x] = (row_two_size + search_palette(pixel, palette_to_pixel));
 		}
     }
 
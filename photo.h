@@ -53,6 +53,21 @@
 #define MAX_OBJECT_HEIGHT 100
 
 
+/* 
+ * Palette upload counters.  prep_room writes only the ranges of DAC colors
+ * that changed since the previous room; dac_bytes counts the color bytes
+ * sent to the DAC data port (three per color), and dac_ranges the number
+ * of contiguous ranges (each costing one write to the DAC index port).
+ */
+typedef struct palette_stats_t palette_stats_t;
+struct palette_stats_t {
+    unsigned long room_changes;	  /* calls to prep_room                  */
+    unsigned long dac_ranges;	  /* contiguous color ranges written     */
+    unsigned long dac_bytes;	  /* total color bytes written           */
+    unsigned long last_dac_bytes; /* color bytes written by the last call */
+};
+
+
 /* Fill a buffer with the pixels for a horizontal line of current room. */
 extern void fill_horiz_buffer (int x, int y, unsigned char buf[SCROLL_X_DIM]);
 
@@ -77,12 +92,40 @@ extern uint32_t photo_width (const photo_t* p);
  */
 extern void prep_room (const room_t* r);
 
+/* 
+ * Bring the pre-rendered image of the current room, if any, up to date 
+ * after objects have moved.
+ */
+extern void refresh_room (void);
+
+/* 
+ * Turn drawing of objects by the fill functions on (1) or off (0); returns
+ * 1 if the room should be redrawn because lines were drawn without them.
+ */
+extern int set_object_overlay (int on);
+
+/* 
+ * Returns 1 if turning the object overlay off saves drawing, or 0 if lines
+ * come from the room canvas (which always includes the objects).
+ */
+extern int object_overlay_saves (void);
+
+/* Read the palette upload counters. */
+extern void get_palette_stats (palette_stats_t* stats);
+
 /* Read object image from a file into a dynamically allocated structure. */
 extern image_t* read_obj_image (const char* fname);
 
 /* Read room photo from a file into a dynamically allocated structure. */
 extern photo_t* read_photo (const char* fname);
 
+/* 
+ * Prefault an object image, or a room photo along with a room canvas
+ * large enough for it (see prefault_pages in modex.h).
+ */
+extern void prefault_obj_image (image_t* im);
+extern void prefault_photo (photo_t* p);
+
 /* 
  * N.B.  I'm aware that Valgrind and similar tools will report the fact that
  * I chose not to bother freeing image data before terminating the program.
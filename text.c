@@ -562,76 +562,31 @@ unsigned char font_data[256][16] = {
      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}
 };
 
+/* the glyph atlas (see text.h) and whether it has been built */
+unsigned char glyph_atlas[256][PLANES][FONT_HEIGHT][2];
+static int glyph_atlas_built = 0;
+
 /*
- * text_to_graphics
- *   DESCRIPTION: Creates the buffer for the status bar by writing to all 4 planes in each address.
- *   INPUTS: buf - pointer to the buffer array
- *			 str - pointer to the string (i.e room, status, typed_text)
- *			 alignment - integer that indicates which string is being passed in
+ * init_glyph_atlas
+ *   DESCRIPTION: Build the glyph atlas from font_data, if not already done.
+ *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: Fills buffer array with colors depending on the pixels in the string.
- */   
-
-void text_to_graphics(unsigned char * buf, const char * str, int alignment)
+ *   SIDE EFFECTS: fills glyph_atlas
+ */
+void
+init_glyph_atlas ()
 {
-	int i,j,k;    			/* loop counter variables */
-	int len = strlen(str);
-	unsigned char temp_char;
-	int address;
-	int start_y = 1;
-	int start_x;
-	/* calculate the offsets of each different string */
-	int left_align = 0;
-	int center_align = 40 - len;
-	int right_align = 2*center_align;
+	int c, p, j, h;		/* character, plane, row, and half */
 
-	
-	/* These if statements decides which offset to use based on alignment */
-	if (alignment == 0)
-	{
-		start_x = left_align;
-	}
-	else if (alignment == 1)
-	{
-		start_x = center_align;
-	}
-	else if (alignment == 2)
-	{
-		start_x = right_align;
-	}
-	
-	/* first check if string is empty */
-	if (len != 0)
-	{
-		for(i = 0; i < len; i++)
-		{
-			/* iterate through each row of the letter */
-			for(j = 0; j < FONT_HEIGHT; j++)
-			{
-				/* Iterate through each pixel of a row */
-				temp_char = font_data[(int)str[i]][j];
-				for(k = 0; k < FONT_WIDTH; k++)
-				{
-					/* examine a specific pixel */
-					unsigned char bmask = (128 >> (k));
-					
-					/* calculate the start address of the letter and check each pixel */
-					if ((temp_char & bmask) != 0)
-					{
-						if( k > 3)
-						{
-							address = (k % PLANES * STATUS_SIZE) + (j + start_y) * IMAGE_X_WIDTH + 2*i + 1 + start_x;
-							buf[address] = TEXT_COLOR;
-						}
-						else
-						{
-							address = (k % PLANES * STATUS_SIZE + (start_y + j) * IMAGE_X_WIDTH + 2*i + start_x);
-							buf[address] = TEXT_COLOR;
-						}
-					}
-				}
-			}
-		}
-	}
+	if (glyph_atlas_built)
+		return;
+	for (c = 0; c < 256; c++)
+		for (p = 0; p < PLANES; p++)
+			for (j = 0; j < FONT_HEIGHT; j++)
+				for (h = 0; h < 2; h++)
+					glyph_atlas[c][p][j][h] = 
+					    ((font_data[c][j] & (0x80 >> (4 * h + p))) ?
+					     TEXT_COLOR : COLOR);
+	glyph_atlas_built = 1;
 }
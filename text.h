@@ -56,6 +56,15 @@
 /* Standard VGA text font. */
 extern unsigned char font_data[256][16];
 
-extern void text_to_graphics(unsigned char * buf, const char * str, int alignment);
+/* 
+ * Glyph atlas: each character as drawn in the status bar, already split
+ * into mode X planes.  A character covers two address columns (left and
+ * right halves); glyph_atlas[c][p][j][h] is the color (TEXT_COLOR or 
+ * COLOR) of pixel 4 * h + p in row j of character c.  The atlas is built
+ * from font_data by init_glyph_atlas, which must be called before use 
+ * (further calls have no effect).
+ */
+extern unsigned char glyph_atlas[256][PLANES][FONT_HEIGHT][2];
+extern void init_glyph_atlas (void);
 
 #endif /* TEXT_H */
@@ -0,0 +1,373 @@
+/*									tab:8
+ *
+ * timer_wheel.c - tick-driven hierarchical timer wheel
+ *
+ * Filename:	    timer_wheel.c
+ */
+
+#include <stddef.h>
+
+#include "timer_wheel.h"
+
+
+/*
+ * Set TIMER_WHEEL_BENCHMARK to 1 (see the tw-bench target in the Makefile)
+ * to build a stand-alone program that measures the throughput of adding,
+ * cancelling, and expiring timers.
+ */
+#if !defined(TIMER_WHEEL_BENCHMARK)
+#define TIMER_WHEEL_BENCHMARK 0
+#endif
+
+
+/* local functions--see function headers for details */
+
+static void link_timer (timer_wheel_t* w, game_timer_t* t);
+static void unlink_timer (game_timer_t* t);
+static void cascade (timer_wheel_t* w, int level);
+
+
+/*
+ * link_timer
+ *   DESCRIPTION: Put a timer into the slot that covers its due tick,
+ *                relative to the wheel's current tick.  Timers already
+ *                due go into the slot processed next.
+ *   INPUTS: w -- the wheel
+ *           t -- the timer (not pending)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: links t into one of w's slot lists
+ */
+static void
+link_timer (timer_wheel_t* w, game_timer_t* t)
+{
+    uint32_t delta = t->due - w->now; /* ticks until due */
+    game_timer_t* head;               /* list for slot   */
+    int level;                        /* level of slot   */
+
+    if (0 > (int32_t)delta) {
+	head = &w->slot[0][w->now & (TW_SLOTS - 1)];
+    } else {
+	for (level = 0; TW_LEVELS - 1 > level; level++) {
+	    if ((1UL << (TW_SLOT_BITS * (level + 1))) > delta) {
+		break;
+	    }
+	}
+	head = &w->slot[level][(t->due >> (TW_SLOT_BITS * level)) &
+			       (TW_SLOTS - 1)];
+    }
+    t->next = head;
+    t->prev = head->prev;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+
+/*
+ * unlink_timer
+ *   DESCRIPTION: Remove a timer from its slot list.
+ *   INPUTS: t -- the timer (pending)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: marks t as not pending
+ */
+static void
+unlink_timer (game_timer_t* t)
+{
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->next = t->prev = NULL;
+}
+
+
+/*
+ * cascade
+ *   DESCRIPTION: Move the timers in the current slot of a level down to
+ *                lower levels.  Called as the wheel wraps around the
+ *                level below.
+ *   INPUTS: w -- the wheel
+ *           level -- level to cascade (1 to TW_LEVELS - 1)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: relinks timers
+ */
+static void
+cascade (timer_wheel_t* w, int level)
+{
+    game_timer_t* head;  /* list for current slot of level */
+    game_timer_t* t;     /* timer being moved              */
+
+    head = &w->slot[level][(w->now >> (TW_SLOT_BITS * level)) &
+			   (TW_SLOTS - 1)];
+    while (head != (t = head->next)) {
+	unlink_timer (t);
+	link_timer (w, t);
+    }
+}
+
+
+/*
+ * timer_wheel_init
+ *   DESCRIPTION: Empty a timer wheel and set its current tick.
+ *   INPUTS: w -- the wheel
+ *           now -- the current tick
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: forgets any pending timers
+ */
+void
+timer_wheel_init (timer_wheel_t* w, uint32_t now)
+{
+    int level;  /* loop index over levels */
+    int i;      /* loop index over slots  */
+
+    w->now = now;
+    w->pending = 0;
+    for (level = 0; TW_LEVELS > level; level++) {
+	for (i = 0; TW_SLOTS > i; i++) {
+	    w->slot[level][i].next = w->slot[level][i].prev =
+		    &w->slot[level][i];
+	}
+    }
+}
+
+
+/*
+ * timer_init
+ *   DESCRIPTION: Prepare a timer for use.
+ *   INPUTS: t -- the timer
+ *           fn -- function to call when the timer expires
+ *           arg -- argument to pass to fn
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+timer_init (game_timer_t* t, timer_fn_t fn, void* arg)
+{
+    t->next = t->prev = NULL;
+    t->due = 0;
+    t->fn = fn;
+    t->arg = arg;
+}
+
+
+/*
+ * timer_add
+ *   DESCRIPTION: Schedule a timer to expire delay ticks after the wheel's
+ *                current tick, cancelling it first if it is pending.
+ *   INPUTS: w -- the wheel
+ *           t -- the timer
+ *           delay -- ticks until expiry (at most TW_MAX_DELAY)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void
+timer_add (timer_wheel_t* w, game_timer_t* t, uint32_t delay)
+{
+    if (NULL != t->next) {
+	unlink_timer (t);
+    } else {
+	w->pending++;
+    }
+    if (TW_MAX_DELAY < delay) {
+	delay = TW_MAX_DELAY;
+    }
+    t->due = w->now + delay;
+    link_timer (w, t);
+}
+
+
+/*
+ * timer_cancel
+ *   DESCRIPTION: Cancel a timer.
+ *   INPUTS: w -- the wheel
+ *           t -- the timer
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the timer was pending, 0 if not
+ *   SIDE EFFECTS: none
+ */
+int
+timer_cancel (timer_wheel_t* w, game_timer_t* t)
+{
+    if (NULL == t->next) {
+	return 0;
+    }
+    unlink_timer (t);
+    w->pending--;
+    return 1;
+}
+
+
+/*
+ * timer_pending
+ *   DESCRIPTION: Check whether a timer is pending.
+ *   INPUTS: t -- the timer
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the timer is pending, 0 if not
+ *   SIDE EFFECTS: none
+ */
+int
+timer_pending (const game_timer_t* t)
+{
+    return (NULL != t->next);
+}
+
+
+/*
+ * timer_wheel_advance
+ *   DESCRIPTION: Turn the wheel through all ticks up to and including
+ *                tick, calling the callback of each timer as it expires.
+ *                Ticks already processed are ignored.
+ *   INPUTS: w -- the wheel
+ *           tick -- last tick to process
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of callbacks called
+ *   SIDE EFFECTS: calls timer callbacks
+ */
+unsigned long
+timer_wheel_advance (timer_wheel_t* w, uint32_t tick)
+{
+    unsigned long fired = 0; /* callbacks called                   */
+    uint32_t cur;            /* tick being processed               */
+    game_timer_t* head;      /* list for current slot of level 0   */
+    game_timer_t* t;         /* expiring timer                     */
+    int level;               /* loop index over levels to cascade  */
+
+    while (0 <= (int32_t)(tick - w->now)) {
+
+	/*
+	 * Refill level 0 from above as it wraps around.  Skip the work
+	 * entirely if no timers are pending, which lets long idle stretches
+	 * pass in a single step.
+	 */
+	if (0 == w->pending) {
+	    w->now = tick + 1;
+	    break;
+	}
+	for (level = 1; TW_LEVELS > level; level++) {
+	    if (0 != ((w->now >> (TW_SLOT_BITS * (level - 1))) &
+		      (TW_SLOTS - 1))) {
+		break;
+	    }
+	    cascade (w, level);
+	}
+
+	/*
+	 * Expire the timers in the current slot.  The wheel moves on to
+	 * the next tick first, so that timers added by callbacks are
+	 * scheduled relative to it; those added to this slot (with a
+	 * delay of TW_SLOTS - 1) follow the expiring timers in the list.
+	 */
+	cur = w->now++;
+	head = &w->slot[0][cur & (TW_SLOTS - 1)];
+	while (head != (t = head->next) && 0 >= (int32_t)(t->due - cur)) {
+	    unlink_timer (t);
+	    w->pending--;
+	    fired++;
+	    t->fn (t->arg);
+	}
+    }
+    return fired;
+}
+
+
+#if (TIMER_WHEEL_BENCHMARK == 1)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_TIMERS 100000  /* timers in the stress test   */
+#define BENCH_ROUNDS 10      /* repetitions of each phase   */
+
+static timer_wheel_t w;           /* wheel under test                */
+static unsigned long bench_fired; /* callbacks seen by the benchmark */
+static unsigned long bench_late;  /* callbacks not on their due tick */
+
+/* benchmark timer callback: counts calls and checks timing */
+static void
+bench_fn (void* arg)
+{
+    bench_fired++;
+    if (((game_timer_t*)arg)->due != w.now - 1) {
+	bench_late++;
+    }
+}
+
+/* nanoseconds elapsed since start */
+static double
+bench_nsec (const struct timespec* start)
+{
+    struct timespec now;
+
+    (void)clock_gettime (CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e9 +
+	   (now.tv_nsec - start->tv_nsec);
+}
+
+int
+main ()
+{
+    game_timer_t* t;         /* the timers                   */
+    uint32_t* delay;         /* random delay for each timer  */
+    struct timespec start;   /* start of timed phase         */
+    double add_ns = 0, cancel_ns = 0, expire_ns = 0;
+    unsigned long expired = 0;
+    int round, i;
+
+    t = malloc (BENCH_TIMERS * sizeof (t[0]));
+    delay = malloc (BENCH_TIMERS * sizeof (delay[0]));
+    if (NULL == t || NULL == delay) {
+	return 3;
+    }
+    srand (1);
+    for (i = 0; BENCH_TIMERS > i; i++) {
+	timer_init (&t[i], bench_fn, &t[i]);
+	/* mostly short delays, with a tail out to about an hour of ticks */
+	delay[i] = (0 == (i & 7) ? rand () % 72000 : rand () % 200);
+    }
+
+    for (round = 0; BENCH_ROUNDS > round; round++) {
+	timer_wheel_init (&w, round * 12345);
+
+	(void)clock_gettime (CLOCK_MONOTONIC, &start);
+	for (i = 0; BENCH_TIMERS > i; i++) {
+	    timer_add (&w, &t[i], delay[i]);
+	}
+	add_ns += bench_nsec (&start);
+
+	/* cancel every other timer */
+	(void)clock_gettime (CLOCK_MONOTONIC, &start);
+	for (i = 0; BENCH_TIMERS > i; i += 2) {
+	    (void)timer_cancel (&w, &t[i]);
+	}
+	cancel_ns += bench_nsec (&start);
+
+	/* then run the wheel until the rest expire */
+	bench_fired = 0;
+	(void)clock_gettime (CLOCK_MONOTONIC, &start);
+	expired += timer_wheel_advance (&w, w.now + 72000);
+	expire_ns += bench_nsec (&start);
+	if (bench_fired != BENCH_TIMERS / 2 || 0 != w.pending ||
+	    0 != bench_late) {
+	    fprintf (stderr, "timer wheel failed: %lu fired (%lu late), "
+		     "%lu left\n", bench_fired, bench_late, w.pending);
+	    return 3;
+	}
+    }
+
+    printf ("%d timers x %d rounds\n", BENCH_TIMERS, BENCH_ROUNDS);
+    printf ("add:    %6.1f ns/timer\n",
+	    add_ns / (BENCH_TIMERS * (double)BENCH_ROUNDS));
+    printf ("cancel: %6.1f ns/timer\n",
+	    cancel_ns / (BENCH_TIMERS / 2 * (double)BENCH_ROUNDS));
+    printf ("expire: %6.1f ns/timer (including 72000 ticks per round)\n",
+	    expire_ns / expired);
+    free (t);
+    free (delay);
+    return 0;
+}
+
+#endif /* TIMER_WHEEL_BENCHMARK */
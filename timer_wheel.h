@@ -0,0 +1,84 @@
+/*									tab:8
+ *
+ * timer_wheel.h - header file for the tick-driven timer wheel
+ *
+ * Filename:	    timer_wheel.h
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+
+
+/*
+ * NOTES
+ *
+ * A timer wheel holds pending timed events (timers), each due at a
+ * particular tick.  The wheel has TW_LEVELS levels of TW_SLOTS slots; a
+ * slot is a doubly-linked list of timers, so adding or cancelling a timer
+ * takes constant time no matter how many are pending.  Level 0 has one
+ * slot per tick for the next TW_SLOTS ticks; each slot of level k covers
+ * TW_SLOTS^k ticks.  As the wheel turns past a slot of level 0, the next
+ * slot of level 1 is emptied and its timers are spread out over level 0
+ * (and similarly for higher levels), so each timer is moved at most
+ * TW_LEVELS - 1 times before it expires.
+ *
+ * Timers are embedded in the caller's structures, not allocated by the
+ * wheel.  A timer's callback is called from timer_wheel_advance and may
+ * add or cancel any timers, including its own.
+ */
+
+#define TW_SLOT_BITS 6                         /* log2 of slots per level  */
+#define TW_SLOTS     (1 << TW_SLOT_BITS)       /* slots per level          */
+#define TW_LEVELS    4                         /* levels in the wheel      */
+#define TW_MAX_DELAY ((1UL << (TW_SLOT_BITS * TW_LEVELS)) - 1) /* in ticks */
+
+typedef struct game_timer_t game_timer_t;
+typedef struct timer_wheel_t timer_wheel_t;
+
+/* a timer's callback, called with the timer's argument when it expires */
+typedef void (*timer_fn_t) (void* arg);
+
+/* a pending timed event; treat as opaque */
+struct game_timer_t {
+    game_timer_t* next;  /* neighbors in slot list, or NULL if not pending */
+    game_timer_t* prev;
+    uint32_t      due;   /* tick at which the timer expires                */
+    timer_fn_t    fn;    /* callback                                       */
+    void*         arg;   /* argument for callback                          */
+};
+
+/* a wheel of pending timers; treat as opaque */
+struct timer_wheel_t {
+    uint32_t     now;                          /* next tick to process     */
+    unsigned long pending;                     /* number of timers pending */
+    game_timer_t slot[TW_LEVELS][TW_SLOTS];    /* list heads               */
+};
+
+/* empty the wheel and set its current tick */
+extern void timer_wheel_init (timer_wheel_t* w, uint32_t now);
+
+/* prepare a timer for use (not pending) */
+extern void timer_init (game_timer_t* t, timer_fn_t fn, void* arg);
+
+/*
+ * (re)schedule a timer to expire delay ticks from the wheel's current
+ * tick (a delay of 0 expires on the next advance); delays longer than
+ * TW_MAX_DELAY are shortened to TW_MAX_DELAY
+ */
+extern void timer_add (timer_wheel_t* w, game_timer_t* t, uint32_t delay);
+
+/* cancel a timer; returns 1 if it was pending, 0 if not */
+extern int timer_cancel (timer_wheel_t* w, game_timer_t* t);
+
+/* returns 1 if a timer is pending, 0 if not */
+extern int timer_pending (const game_timer_t* t);
+
+/*
+ * process all ticks up to and including tick, calling the callbacks of
+ * timers that expire; returns the number of callbacks called
+ */
+extern unsigned long timer_wheel_advance (timer_wheel_t* w, uint32_t tick);
+
+#endif /* TIMER_WHEEL_H */
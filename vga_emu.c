@@ -0,0 +1,451 @@
+/*									tab:8
+ *
+ * vga_emu.c - software VGA for running mode X code without hardware
+ *
+ * Filename:	    vga_emu.c
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "vga_emu.h"
+
+
+/* emulated VGA parameters */
+#define PLANE_SIZE         65536 /* bytes of video memory per plane        */
+#define NUM_SEQ_REGS           5
+#define NUM_CRTC_REGS         25
+#define NUM_GRAPHICS_REGS      9
+#define MAX_FRAME_X_DIM      720 /* bounds on the composed frame size      */
+#define MAX_FRAME_Y_DIM      480
+#define EMU_REFRESH_USEC   14268 /* retrace timing reported at port 0x3DA */
+#define EMU_RETRACE_USEC      64
+#define DUMP_FPS              20 /* nominal frame rate for Y4M streams    */
+
+/* dump formats selected by VGA_DUMP */
+typedef enum {DUMP_NONE, DUMP_Y4M, DUMP_PPM_SEQ, DUMP_PPM_LAST} dump_fmt_t;
+
+/* local functions--see function headers for details */
+static void compose_frame ();
+static void write_frame ();
+static long long now_usec ();
+
+/* emulated device state */
+static unsigned char planes[4][PLANE_SIZE];
+static unsigned char seq_idx, seq[NUM_SEQ_REGS];
+static unsigned char crtc_idx, crtc[NUM_CRTC_REGS];
+static unsigned char gfx_idx, gfx[NUM_GRAPHICS_REGS];
+static unsigned char dac[256][3];
+static unsigned char dac_idx, dac_comp;
+static long long epoch;
+
+/* frame composition and dump state */
+static unsigned char frame[MAX_FRAME_Y_DIM][MAX_FRAME_X_DIM][3];
+static int frame_w, frame_h;
+static int shown;		    /* a start address has been displayed */
+static unsigned long n_frames;
+static dump_fmt_t dump_fmt = DUMP_NONE;
+static const char* dump_name;
+static FILE* dump_file;
+
+
+/*
+ * vga_emu_init
+ *   DESCRIPTION: Reset the emulated VGA and open the frame dump selected
+ *                by the VGA_DUMP environment variable.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the dump file cannot be opened or
+ *                 its name has a bad frame number conversion
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+int
+vga_emu_init ()
+{
+    size_t len; /* length of dump file name */
+    const char* conv; /* frame number conversion in dump file name */
+
+    (void)memset (planes, 0, sizeof (planes));
+    (void)memset (crtc, 0, sizeof (crtc));
+    seq[2] = 0x0F;
+    shown = 0;
+    n_frames = 0;
+    epoch = now_usec ();
+
+    if (NULL == (dump_name = getenv ("VGA_DUMP")) || '\0' == *dump_name) {
+	dump_fmt = DUMP_NONE;
+	return 0;
+    }
+    len = strlen (dump_name);
+    if (NULL != (conv = strchr (dump_name, '%'))) {
+	/* the name is used as a printf format, so allow only one %d or
+	   %0<width>d in it */
+	conv++;
+	if ('0' == *conv) {
+	    conv++;
+	}
+	while (isdigit ((unsigned char)*conv)) {
+	    conv++;
+	}
+	if ('d' != *conv || NULL != strchr (conv, '%')) {
+	    fprintf (stderr, "VGA_DUMP may contain only one %%d or %%0Nd\n");
+	    return -1;
+	}
+        dump_fmt = DUMP_PPM_SEQ;
+    } else if (4 < len && 0 == strcmp (dump_name + len - 4, ".y4m")) {
+        dump_fmt = DUMP_Y4M;
+	if (NULL == (dump_file = fopen (dump_name, "wb"))) {
+	    perror ("open VGA_DUMP");
+	    return -1;
+	}
+    } else {
+        dump_fmt = DUMP_PPM_LAST;
+    }
+    return 0;
+}
+
+
+/*
+ * vga_emu_close
+ *   DESCRIPTION: Dump the frame on display and close the dump file.  Must
+ *                be called before the mode X registers are replaced.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may write a frame
+ */
+void
+vga_emu_close ()
+{
+    if (shown) {
+        compose_frame ();
+	write_frame ();
+	shown = 0;
+    }
+    if (NULL != dump_file) {
+        (void)fclose (dump_file);
+	dump_file = NULL;
+    }
+}
+
+
+/*
+ * vga_emu_outb
+ *   DESCRIPTION: Write a byte to an emulated VGA port.  Index/data port
+ *                pairs for the sequencer, CRTC, and graphics controller
+ *                are tracked, as are the DAC write index and palette data.
+ *                Other ports are accepted and ignored.
+ *   INPUTS: port -- the port
+ *           val -- the value written
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes emulated register state
+ */
+void
+vga_emu_outb (unsigned short port, unsigned char val)
+{
+    switch (port) {
+	case 0x03C4: seq_idx = val; break;
+	case 0x03C5:
+	    if (NUM_SEQ_REGS > seq_idx)
+		seq[seq_idx] = val;
+	    break;
+	case 0x03D4: crtc_idx = val; break;
+	case 0x03D5:
+	    if (NUM_CRTC_REGS > crtc_idx)
+		crtc[crtc_idx] = val;
+	    break;
+	case 0x03CE: gfx_idx = val; break;
+	case 0x03CF:
+	    if (NUM_GRAPHICS_REGS > gfx_idx)
+		gfx[gfx_idx] = val;
+	    break;
+	case 0x03C8: dac_idx = val; dac_comp = 0; break;
+	case 0x03C9:
+	    dac[dac_idx][dac_comp] = (val & 0x3F);
+	    if (3 == ++dac_comp) {
+		dac_comp = 0;
+		dac_idx++;
+	    }
+	    break;
+	default: break;
+    }
+}
+
+
+/*
+ * vga_emu_outw
+ *   DESCRIPTION: Write two bytes to two consecutive emulated ports, as
+ *                an x86 OUTW does (low byte first).
+ *   INPUTS: port -- the first port
+ *           val -- the value written
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes emulated register state
+ */
+void
+vga_emu_outw (unsigned short port, unsigned short val)
+{
+    vga_emu_outb (port, val & 0xFF);
+    vga_emu_outb (port + 1, val >> 8);
+}
+
+
+/*
+ * vga_emu_inb
+ *   DESCRIPTION: Read a byte from an emulated VGA port.  Input status
+ *                register 1 reports vertical retrace on a 70 Hz schedule
+ *                taken from the system clock; sequencer and CRTC data
+ *                ports return the indexed register.
+ *   INPUTS: port -- the port
+ *   OUTPUTS: none
+ *   RETURN VALUE: the value read
+ *   SIDE EFFECTS: none
+ */
+unsigned char
+vga_emu_inb (unsigned short port)
+{
+    switch (port) {
+	case 0x03DA:
+	    return ((now_usec () - epoch) % EMU_REFRESH_USEC <
+		    EMU_RETRACE_USEC ? 0x09 : 0x00);
+	case 0x03C5:
+	    return (NUM_SEQ_REGS > seq_idx ? seq[seq_idx] : 0);
+	case 0x03D5:
+	    return (NUM_CRTC_REGS > crtc_idx ? crtc[crtc_idx] : 0);
+	default:
+	    return 0;
+    }
+}
+
+
+/*
+ * vga_emu_write
+ *   DESCRIPTION: Write data to video memory in each plane enabled by the
+ *                sequencer map mask (register 2), as a host write to the
+ *                mode X frame buffer does.  Writes beyond the end of a
+ *                plane are dropped.
+ *   INPUTS: addr -- offset in video memory
+ *           src -- data to write
+ *           n -- number of bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes emulated video memory
+ */
+void
+vga_emu_write (unsigned int addr, const unsigned char* src, unsigned int n)
+{
+    int p; /* loop index over planes */
+
+    if (PLANE_SIZE <= addr)
+        return;
+    if (PLANE_SIZE - addr < n)
+        n = PLANE_SIZE - addr;
+    for (p = 0; p < 4; p++) {
+	if (0 != (seq[2] & (1 << p)))
+	    (void)memcpy (planes[p] + addr, src, n);
+    }
+}
+
+
+/*
+ * vga_emu_fill
+ *   DESCRIPTION: Fill video memory in each plane enabled by the sequencer
+ *                map mask.
+ *   INPUTS: addr -- offset in video memory
+ *           val -- value to write
+ *           n -- number of bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes emulated video memory
+ */
+void
+vga_emu_fill (unsigned int addr, unsigned char val, unsigned int n)
+{
+    int p; /* loop index over planes */
+
+    if (PLANE_SIZE <= addr)
+        return;
+    if (PLANE_SIZE - addr < n)
+        n = PLANE_SIZE - addr;
+    for (p = 0; p < 4; p++) {
+	if (0 != (seq[2] & (1 << p)))
+	    (void)memset (planes[p] + addr, val, n);
+    }
+}
+
+
+/*
+ * vga_emu_present
+ *   DESCRIPTION: Called just before the display start address changes.
+ *                Composes the frame that has been on display since the
+ *                previous change (including anything drawn outside the
+ *                scrolling area meanwhile, such as the status bar) and
+ *                writes it to the dump.  The first call only notes that
+ *                a start address is now in use.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may write a frame
+ */
+void
+vga_emu_present ()
+{
+    if (shown) {
+        compose_frame ();
+	write_frame ();
+    }
+    shown = 1;
+}
+
+
+/*
+ * vga_emu_frames
+ *   DESCRIPTION: Get the number of frames composed so far.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of frames
+ *   SIDE EFFECTS: none
+ */
+unsigned long
+vga_emu_frames ()
+{
+    return n_frames;
+}
+
+
+/*
+ * compose_frame
+ *   DESCRIPTION: Scan out the emulated display into RGB pixels.  The
+ *                geometry is taken from the CRTC: horizontal display end,
+ *                vertical display end, maximum scan line (for doubling),
+ *                offset (row stride), start address, and line compare,
+ *                after which scanning restarts at address 0.  Pixels are
+ *                read unchained (mode X): pixel x comes from plane x & 3.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: fills the frame buffer
+ */
+static void
+compose_frame ()
+{
+    unsigned int start;     /* display start address                   */
+    unsigned int stride;    /* bytes per row in each plane             */
+    unsigned int line_cmp;  /* line compare scan line                  */
+    unsigned int vde;       /* last displayed scan line                */
+    unsigned int lines;     /* scan lines per row                      */
+    unsigned int row_addr;  /* video memory address of current row     */
+    unsigned char color;    /* palette index of a pixel                */
+    int y, x, c;	    /* loop indices over rows, pixels, colors  */
+    int split;		    /* row at which line compare took effect   */
+
+    start = (crtc[0x0C] << 8) | crtc[0x0D];
+    stride = crtc[0x13] * 2;
+    lines = (crtc[0x09] & 0x1F) + 1;
+    line_cmp = crtc[0x18] | ((crtc[0x07] & 0x10) << 4) |
+	       ((crtc[0x09] & 0x40) << 3);
+    vde = crtc[0x12] | ((crtc[0x07] & 0x02) << 7) | ((crtc[0x07] & 0x40) << 3);
+    frame_w = (crtc[0x01] + 1) * 4;
+    frame_h = (vde + 1) / lines;
+    if (MAX_FRAME_X_DIM < frame_w)
+        frame_w = MAX_FRAME_X_DIM;
+    if (MAX_FRAME_Y_DIM < frame_h)
+        frame_h = MAX_FRAME_Y_DIM;
+
+    split = -1;
+    for (y = 0; y < frame_h; y++) {
+	if (0 > split && y * lines > line_cmp)
+	    split = y;
+	row_addr = (0 > split ? start + y * stride : (y - split) * stride);
+	for (x = 0; x < frame_w; x++) {
+	    color = planes[x & 3][(row_addr + (x >> 2)) % PLANE_SIZE];
+	    for (c = 0; c < 3; c++)
+		frame[y][x][c] = (dac[color][c] << 2) | (dac[color][c] >> 4);
+	}
+    }
+    n_frames++;
+}
+
+
+/*
+ * write_frame
+ *   DESCRIPTION: Write the composed frame in the dump format.  Y4M frames
+ *                are converted to BT.601 YCbCr with 4:4:4 sampling; the
+ *                stream header is written with the first frame.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes to the dump file(s)
+ */
+static void
+write_frame ()
+{
+    static unsigned char ycc[3][MAX_FRAME_Y_DIM * MAX_FRAME_X_DIM];
+    char fname[1024];	/* file name for PPM frames        */
+    FILE* out;		/* output file for PPM frames      */
+    int y, x, i;	/* loop indices over rows, pixels  */
+    int r, g, b;	/* color components of a pixel     */
+
+    switch (dump_fmt) {
+	case DUMP_NONE:
+	    return;
+
+	case DUMP_Y4M:
+	    if (1 == n_frames) {
+		fprintf (dump_file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n",
+			 frame_w, frame_h, DUMP_FPS);
+	    }
+	    for (y = 0, i = 0; y < frame_h; y++) {
+		for (x = 0; x < frame_w; x++, i++) {
+		    r = frame[y][x][0];
+		    g = frame[y][x][1];
+		    b = frame[y][x][2];
+		    ycc[0][i] = (( 66 * r + 129 * g +  25 * b + 128) >> 8) + 16;
+		    ycc[1][i] = ((-38 * r -  74 * g + 112 * b + 128) >> 8) + 128;
+		    ycc[2][i] = ((112 * r -  94 * g -  18 * b + 128) >> 8) + 128;
+		}
+	    }
+	    fprintf (dump_file, "FRAME\n");
+	    for (i = 0; i < 3; i++)
+		(void)fwrite (ycc[i], frame_w * frame_h, 1, dump_file);
+	    return;
+
+	case DUMP_PPM_SEQ:
+	case DUMP_PPM_LAST:
+	    if (DUMP_PPM_SEQ == dump_fmt) {
+		(void)snprintf (fname, sizeof (fname), dump_name, (int)n_frames);
+	    } else {
+		(void)snprintf (fname, sizeof (fname), "%s", dump_name);
+	    }
+	    if (NULL == (out = fopen (fname, "wb"))) {
+		return;
+	    }
+	    fprintf (out, "P6\n%d %d\n255\n", frame_w, frame_h);
+	    for (y = 0; y < frame_h; y++)
+		(void)fwrite (frame[y], frame_w * 3, 1, out);
+	    (void)fclose (out);
+	    return;
+    }
+}
+
+
+/*
+ * now_usec
+ *   DESCRIPTION: Read the current time in microseconds.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: current time of day in microseconds
+ *   SIDE EFFECTS: none
+ */
+static long long
+now_usec ()
+{
+    struct timeval tv; /* current time */
+
+    (void)gettimeofday (&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
@@ -0,0 +1,61 @@
+/*									tab:8
+ *
+ * vga_emu.h - header file for the software VGA used by headless builds
+ *
+ * Filename:	    vga_emu.h
+ */
+
+#ifndef VGA_EMU_H
+#define VGA_EMU_H
+
+
+/*
+ * NOTES
+ *
+ * When modex.c is compiled with VGA_HEADLESS defined, all VGA port I/O
+ * and all writes into the mode X frame buffer are redirected here instead
+ * of to the hardware.  The emulation keeps the four 64kB planes, the
+ * sequencer map mask, the CRTC registers (start address, line compare,
+ * scan doubling, and row offset), and the DAC palette in ordinary memory,
+ * so neither ioperm nor /dev/mem (and hence no root privilege) is needed.
+ *
+ * Each time the display start address is about to change, the frame that
+ * has been on the "monitor" since the previous change is composed from the
+ * planes and palette and written according to the VGA_DUMP environment
+ * variable:
+ *
+ *   VGA_DUMP unset         -- frames are composed but not written
+ *   VGA_DUMP=name.y4m      -- all frames appended to a YUV4MPEG2 stream
+ *   VGA_DUMP=frame%05d.ppm -- one binary PPM file per frame (printf format)
+ *   VGA_DUMP=name.ppm      -- the most recent frame only
+ */
+
+/* allocate emulated video memory and open the frame dump, if any */
+extern int vga_emu_init ();
+
+/* emit the last frame and close the frame dump */
+extern void vga_emu_close ();
+
+/* port I/O to the emulated VGA */
+extern void vga_emu_outb (unsigned short port, unsigned char val);
+extern void vga_emu_outw (unsigned short port, unsigned short val);
+extern unsigned char vga_emu_inb (unsigned short port);
+
+/*
+ * write n bytes from src to video memory offset addr in each plane
+ * enabled by the sequencer map mask
+ */
+extern void vga_emu_write (unsigned int addr, const unsigned char* src,
+			   unsigned int n);
+
+/* fill n bytes at video memory offset addr in each enabled plane */
+extern void vga_emu_fill (unsigned int addr, unsigned char val,
+			  unsigned int n);
+
+/* compose and dump the frame currently on display */
+extern void vga_emu_present ();
+
+/* number of frames composed so far */
+extern unsigned long vga_emu_frames ();
+
+#endif /* VGA_EMU_H */
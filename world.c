@@ -153,6 +153,9 @@ enum {
     N_OBJECTS
 };
 
+/* object name index, generated from obj_data.def (uses object identifiers) */
+#include "name_hash.h"
+
 /* flag identifiers for recording the player's accomplishments */
 enum {
     FLAG_HAS_EATEN,	/* player has eaten something         */
@@ -184,6 +187,8 @@ struct room_t {
     room_t*     left;   	/* room to the "left"             */
     room_t*     enter;  	/* doors, etc.                    */
     room_t*     right;  	/* room to the "right"            */
+    uint32_t    version;	/* changes when the room's image  */
+				/*    (photo or contents) changes */
 };
 
 /*
@@ -381,26 +386,10 @@ struct obj_data_t {
 
 /* the object positioning data */
 static const obj_data_t obj_data[N_OBJECTS] = {
-    {     O_BOARD, "board", "images/board.obj", R_IN_IEEE, -1, -1},
-    {   O_JETPACK, "jetpack", "images/jetpack.obj", R_TALBOT, -1, -1},
-    {       O_TUX, "tux", "images/tux.obj", R_REM_LAB, 250, 100},
-    {       O_MP2, "mp2", "images/mp2.obj", R_CSLLOUNGE, -1, -1},
-    {    O_BOOK_C, "book", "images/book.obj", R_NONE, -1, -1},
-    { O_BOOK_WODE, "book", "images/book2.obj", R_NONE, -1, -1},
-    {   O_GPS_BAD, "gps", "images/gpsbad.obj", R_TALBOT, -1, -1},
-    {  O_GPS_GOOD, "gps", "images/gpsgood.obj", R_NONE, -1, -1},
-    {  O_GPS_SPEC, "spec", "images/gpsspec.obj", R_CSL_UPPER, -1, -1},
-    { O_BUNNYSUIT, "bunnysuit", "images/bunnysuit.obj", R_ALMAMATER, 230, 250},
-    {O_BATT_EMPTY, "battery", "images/battery.obj", R_NONE, -1, -1},
-    { O_BATT_FULL, "battery", "images/battery.obj", R_NONE, -1, -1},
-    {  O_BATT_CAR, "battery", "images/batteryincar.obj", R_NONE, -1, -1},
-    {   O_MTN_DEW, "dew", "images/dew.obj", R_NONE, -1, -1},
-    {      O_FISH, "fish", "images/fish.obj", R_EAST_BONE, 80, 260},
-    {     O_ICARD, "Icard", "images/icard.obj", R_BARDEEN, -1, -1},
-    {   O_CAR_KEY, "key", "images/key.obj", R_CARIBOU, -1, -1},
-    {O_ROBOT_DEAD, "robot", "images/robot.obj", R_MNTL_LAB3, -1, -1},
-    {O_ROBOT_LIVE, "robot", "images/robot.obj", R_NONE, -1, -1},
-    { O_MIMO_CARD, "mimo", "images/mimo.obj", R_STATUE, -1, -1}
+#define OBJ_DATA(id, name, filename, room, x, y) \
+    {id, name, filename, room, x, y},
+#include "obj_data.def"
+#undef OBJ_DATA
 };
 
 /*
@@ -425,6 +414,7 @@ static const swap_data_t swap_data[N_SWAPS] = {
 /* functions local to this file--see function headers for details */
 static void do_photo_swap (room_t* r, int32_t which);
 static object_t* find_in_room (const room_t* r, const char* arg);
+static int32_t find_obj_name (const char* arg);
 static void insert_object_at (object_t* o, room_t* r, int32_t x, int32_t y);
 static void insert_object (object_t* o, room_t* r);
 static void move_object_to_inventory (object_t* obj);
@@ -464,6 +454,7 @@ do_photo_swap (room_t* r, int32_t which)
     tmp               = r->view;
     r->view           = swap_photo[which];
     swap_photo[which] = tmp;
+    r->version++;
 }
 
 
@@ -480,19 +471,70 @@ do_photo_swap (room_t* r, int32_t which)
 static object_t* 
 find_in_room (const room_t* r, const char* arg)
 {
-    object_t* obj;	/* index over room contents */
+    int32_t   name;	/* name identifier for arg          */
+    int32_t   idx;	/* index over objects with the name */
+    object_t* found;	/* matching object in room          */
+    object_t* obj;	/* index over room contents         */
+
+    /* Look up the name.  If no object has the name, none is here. */
+    if (0 > (name = find_obj_name (arg))) {
+	return NULL;
+    }
 
-    /* Loop over objects in room. */
-    for (obj = r->contents; NULL != obj; obj = obj->next) {
+    /* Check each object with the name; usually there is only one. */
+    found = NULL;
+    for (idx = name_first[name]; name_first[name + 1] > idx; idx++) {
+	if (r == object[name_objs[idx]].loc) {
+	    if (NULL != found) {
+		break;
+	    }
+	    found = &object[name_objs[idx]];
+	}
+    }
 
-	/* If we find a matching object, return it. */
-        if (0 == strcasecmp (arg, obj->name)) {
-	    return obj;
+    /* 
+     * If more than one is in the room, return the first in the room's
+     * contents, as the player would see it.
+     */
+    if (name_first[name + 1] > idx) {
+	for (obj = r->contents; NULL != obj; obj = obj->next) {
+	    if (name == find_obj_name (obj->name)) {
+		return obj;
+	    }
 	}
     }
+    return found;
+}
 
-    /* No object found: return NULL. */
-    return NULL;
+
+/* 
+ * find_obj_name
+ *   DESCRIPTION: Look up an object name in the object name hash table
+ *                (see lexicon.h).  The name must match exactly, although
+ *                the match is not sensitive to case.
+ *   INPUTS: arg -- the name (a string)
+ *   OUTPUTS: none
+ *   RETURN VALUE: the name identifier (OBJ_NAME_*), or -1 if no object
+ *                 has the name
+ *   SIDE EFFECTS: none
+ */
+static int32_t
+find_obj_name (const char* arg)
+{
+    int32_t            len;  /* length of name          */
+    const name_slot_t* slot; /* hash table slot for name */
+
+    if (LEX_MAX_WORD < (len = strlen (arg))) {
+	return -1;
+    }
+    slot = &name_hash[lex_hash (arg, len, NAME_HASH_SEED) &
+		      (NAME_HASH_SIZE - 1)];
+    /* empty slots have no word (and a length of 0, as does "") */
+    if (NULL == slot->word || slot->len != len ||
+        0 != strncasecmp (slot->word, arg, len)) {
+	return -1;
+    }
+    return slot->name;
 }
 
 
@@ -523,6 +565,7 @@ insert_object_at (object_t* o, room_t* r, int32_t x, int32_t y)
     o->loc = r;
     o->next = r->contents;
     r->contents = o;
+    r->version++;
 }
 
 
@@ -624,7 +667,7 @@ static object_t*
 obj_special_get (room_t* r, const char* arg)
 {
     /* Get a book from the Grainger reference desk... */
-    if (&room[R_RESERVE] == r && 0 == strcasecmp ("book", arg)) {
+    if (&room[R_RESERVE] == r && OBJ_NAME_BOOK == find_obj_name (arg)) {
 	/* can only get it once... */
 	if (player_flag_is_set (FLAG_HAS_EATEN)) {
 	    if (NULL == object[O_BOOK_C].loc) {
@@ -708,6 +751,7 @@ remove_object (object_t* o)
 	}
 
 	/* Mark the object's location as NULL. */
+	o->loc->version++;
 	o->loc = NULL;
     }
 }
@@ -806,6 +850,25 @@ room_name (const room_t* r)
 }
 
 
+/* 
+ * room_version
+ *   DESCRIPTION: Get the version number of a room's image.  The number
+ *                changes whenever the room's photo is swapped or an
+ *                object enters or leaves the room, so an image of the
+ *                room drawn at one version remains valid while the 
+ *                version is unchanged.
+ *   INPUTS: r -- pointer to the room
+ *   OUTPUTS: none
+ *   RETURN VALUE: version number of room r's image
+ *   SIDE EFFECTS: none
+ */
+uint32_t
+room_version (const room_t* r)
+{
+    return r->version;
+}
+
+
 /* 
  * room_photo
  *   DESCRIPTION: Get room photo for a room.
@@ -982,6 +1045,39 @@ build_world ()
 }
 
 
+/* 
+ * prefault_world
+ *   DESCRIPTION: Prefault the photos of all rooms (including the photos
+ *                swapped in by special effects) and all object images, so
+ *                that drawing them for the first time does not page-fault.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may page-fault; may reallocate the room canvas
+ */
+void
+prefault_world ()
+{
+    int32_t idx; /* loop index over rooms, objects, and swaps */
+
+    for (idx = 0; N_ROOMS > idx; idx++) {
+	if (NULL != room[idx].view) {
+	    prefault_photo (room[idx].view);
+	}
+    }
+    for (idx = 0; N_OBJECTS > idx; idx++) {
+	if (NULL != object[idx].img) {
+	    prefault_obj_image (object[idx].img);
+	}
+    }
+    for (idx = 0; N_SWAPS > idx; idx++) {
+	if (NULL != swap_photo[idx]) {
+	    prefault_photo (swap_photo[idx]);
+	}
+    }
+}
+
+
 /* 
  * start_in_room
  *   DESCRIPTION: Get a pointer to the room in which the player begins 
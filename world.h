@@ -47,12 +47,16 @@ extern object_t* obj_next (const object_t* obj);
 extern object_t* room_contents_iterate (const room_t* r);
 extern const char* room_name (const room_t* r);
 extern photo_t* room_photo (const room_t* r);
+extern uint32_t room_version (const room_t* r);
 extern uint32_t room_photo_height (const room_t* r);
 extern uint32_t room_photo_width (const room_t* r);
 
 /* Build the game world.  Returns 0 on failure, or 1 on success. */
 extern int32_t build_world (void);
 
+/* Prefault all room photos and object images (see prefault_pages). */
+extern void prefault_world (void);
+
 /* Get pointer to starting room for player. */
 extern room_t* start_in_room (void);
 